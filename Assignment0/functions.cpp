@@ -358,39 +358,26 @@ void reshapeFunc(int w, int h)
 // function that loads OBJ file
 void loadInput()
 {
-	char buffer[MAX_BUFFER_SIZE];
-	while (cin.getline(buffer, MAX_BUFFER_SIZE)) {
+	// the OBJ is piped in on stdin; polygons arrive split into triangles
+	ObjMesh mesh;
+	if (!mesh.load(stdin)) { return; }
 
-		stringstream ss(buffer);
-		Vector3f v; string s;
-		ss >> s;
-
-		if (s == "v") {
-			ss >> v[0] >> v[1] >> v[2];
-			vecv.push_back(v);
-		}
-		else if (s == "vn") {
-			ss >> v[0] >> v[1] >> v[2];
-			vecn.push_back(v);
-		}
-		else if (s == "f") {
-
-			int a, b, c, d, e, f, g, h, i;
-			char ch;
-
-			// loading from obj file into appropariate variables
-			vector<unsigned> vec;
-			ss >> a >> ch >> b >> ch >> c;
-			ss >> d >> ch >> e >> ch >> f;
-			ss >> g >> ch >> h >> ch >> i;
+	for (int k = 0; k < mesh.numVertices(); k++) {
+		vecv.push_back(Vector3f(mesh.positions[3 * k], mesh.positions[3 * k + 1], mesh.positions[3 * k + 2]));
+	}
+	for (size_t k = 0; k < mesh.normals.size(); k += 3) {
+		vecn.push_back(Vector3f(mesh.normals[k], mesh.normals[k + 1], mesh.normals[k + 2]));
+	}
+	for (int j = 0; j < mesh.numTriangles(); j++) {
 
-			vec.push_back(a); vec.push_back(d); vec.push_back(g); // vertex indices
-			vec.push_back(c); vec.push_back(f); vec.push_back(i); // normal indices
-			vec.push_back(b); vec.push_back(e); vec.push_back(h); // ignore for assignment 0
+		// 1-based like the file, 0 where a corner has no index
+		const ObjIndex* corner = &mesh.indices[3 * j];
+		vector<unsigned> vec;
+		vec.push_back(corner[0].v + 1); vec.push_back(corner[1].v + 1); vec.push_back(corner[2].v + 1); // vertex indices
+		vec.push_back(corner[0].vn + 1); vec.push_back(corner[1].vn + 1); vec.push_back(corner[2].vn + 1); // normal indices
+		vec.push_back(corner[0].vt + 1); vec.push_back(corner[1].vt + 1); vec.push_back(corner[2].vt + 1); // ignore for assignment 0
 
-			vecf.push_back(vec);
-		}
-		else { continue; }
-	};
+		vecf.push_back(vec);
+	}
 	return;
 }
\ No newline at end of file
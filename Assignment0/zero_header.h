@@ -10,11 +10,11 @@
 #include <vecmath.h>
 #include <numeric>
 #include <string> 
+#include "../common/ObjLoader.h"
 
 
 // declaring constants 
 const float PI = 3.14159265;
-const unsigned MAX_BUFFER_SIZE = 256; // max size for OBJ file 
 
 // declaring functions 
 inline void glVertex(const Vector3f& );
@@ -16,33 +16,22 @@ void Mesh::load( const char* filename )
 	*/
 
 	// declaring variables
-	fstream fskel; // file stream object
-	string str, s; // for file data
+	ObjMesh obj; // shared OBJ loader, polygons come split into triangles
 	Tuple3u vf; // tuple variable
-	Vector3f v; // vector to store file data
 
-	fskel.open(filename, fstream::in); // opening file
-
-	// checking if file is open
-	if (fskel.is_open() == true) {
+	if (obj.load(filename)) {
 
 		// loop over file data
-		while (getline(fskel, str)) {
-			stringstream stream(str); // stringstream object reading the file string
-			stream >> s; // storing file data to string variable
-
-			// checking type of vector being read
-			if (s == "v") {
-				stream >> v[0] >> v[1] >> v[2];
-				bindVertices.push_back(v);
-			}
-			else if (s == "f") {
-				stream >> vf[0] >> vf[1] >> vf[2];
-				faces.push_back(vf);
-			}
+		for (int i = 0; i < obj.numVertices(); i++) {
+			bindVertices.push_back(Vector3f(obj.positions[3 * i], obj.positions[3 * i + 1], obj.positions[3 * i + 2]));
+		}
+		for (int i = 0; i < obj.numTriangles(); i++) {
+			// faces keep the file's 1-based indices
+			vf[0] = obj.indices[3 * i].v + 1;
+			vf[1] = obj.indices[3 * i + 1].v + 1;
+			vf[2] = obj.indices[3 * i + 2].v + 1;
+			faces.push_back(vf);
 		}
-
-		fskel.close(); // closing read file
 	}
 	else {
 		cout << "Error: File could not be opened!" << endl;
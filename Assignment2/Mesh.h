@@ -13,6 +13,7 @@
 #include <GL/glut.h>
 #endif
 #include "tuple.h"
+#include "../common/ObjLoader.h"
 
 typedef tuple< unsigned, 3 > Tuple3u;
 
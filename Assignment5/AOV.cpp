@@ -0,0 +1,98 @@
+#include "AOV.h"
+#include "Image.h"
+
+#include <cmath>
+
+AOVBuffers::AOVBuffers( int width, int height ) : width(width), height(height), samples(width * height) {
+	depth_min = 0.f; depth_max = 1.f;
+	for (int p = 0; p < NUM_PASSES; p++) {
+		filenames[p] = NULL;
+	}
+}
+
+void AOVBuffers::enable( Pass pass, const char* filename ) {
+	filenames[pass] = filename;
+}
+
+bool AOVBuffers::any() const {
+	for (int p = 0; p < NUM_PASSES; p++) {
+		if (filenames[p] != NULL) { return true; }
+	}
+	return false;
+}
+
+int AOVBuffers::fields() const {
+	return (enabled(NORMAL) ? AOVSample::NORMAL : 0) | (enabled(ALBEDO) ? AOVSample::ALBEDO : 0);
+}
+
+void AOVBuffers::setDepthRange( float depth_min, float depth_max ) {
+	this->depth_min = depth_min;
+	this->depth_max = depth_max;
+}
+
+Vector3f AOVBuffers::color( Pass pass, const AOVSample& sample, int max_hits ) const {
+	/*
+	Description:
+		Maps one sample to the colour shown in the image of a pass.
+	Arguments:
+		- pass: pass being saved.
+		- sample: the pixel's sample.
+		- max_hits: largest hit count in the image, scales the hit count pass.
+	Return:
+		pixel colour, black where the primary ray missed.
+	*/
+
+	if (pass == HIT_COUNT) {
+		return (float(sample.hitCount) / float(max_hits > 0 ? max_hits : 1)) * Vector3f(1., 1., 1.);
+	}
+	if (!sample.hit) {
+		return Vector3f::ZERO;
+	}
+
+	switch (pass) {
+	case DEPTH:
+		if (sample.depth < depth_min) { return Vector3f(1., 1., 1.); }
+		if (sample.depth > depth_max) { return Vector3f::ZERO; }
+		return ((depth_max - sample.depth) / (depth_max - depth_min)) * Vector3f(1., 1., 1.);
+
+	case NORMAL:
+		// ensuring positive definite entries
+		return Vector3f(fabs(sample.normal[0]), fabs(sample.normal[1]), fabs(sample.normal[2]));
+
+	case ALBEDO:
+		return sample.albedo;
+
+	case OBJECT_ID: {
+		// hash the ID into a bright, stable false colour
+		unsigned h = unsigned(sample.objectId + 1) * 2654435761u;
+		return Vector3f(0.25f + 0.75f * float((h >> 8) & 0xff) / 255.f,
+			0.25f + 0.75f * float((h >> 16) & 0xff) / 255.f,
+			0.25f + 0.75f * float((h >> 24) & 0xff) / 255.f);
+	}
+
+	default:
+		return Vector3f::ZERO;
+	}
+}
+
+void AOVBuffers::save() const {
+
+	// declare variables
+	int max_hits = 0;
+
+	for (size_t k = 0; k < samples.size(); k++) {
+		if (samples[k].hitCount > max_hits) { max_hits = samples[k].hitCount; }
+	}
+
+	for (int p = 0; p < NUM_PASSES; p++) {
+		if (filenames[p] == NULL) { continue; }
+
+		Image img(width, height);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				img.SetPixel(x, y, color(Pass(p), samples[y * width + x], max_hits));
+			}
+		}
+		img.SaveBMP(filenames[p]);
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include <cassert>
+#include <vector>
+#include <vecmath.h>
+#include <float.h>
+
+///@brief what the primary ray of one pixel saw, filled by
+///RayTracer::traceRay alongside the beauty colour
+struct AOVSample
+{
+	///@brief fields that cost more than a copy to fill; the others are
+	///always recorded
+	enum Field { NORMAL = 1, ALBEDO = 2, ALL_FIELDS = NORMAL | ALBEDO };
+
+	///@param fields the Fields to fill, the rest keep their reset value
+	explicit AOVSample( int fields = ALL_FIELDS ) : fields(fields) { reset(); }
+
+	///@brief clears the values, the requested fields stay
+	void reset() {
+		hit = false;
+		depth = FLT_MAX;
+		normal = Vector3f::ZERO;
+		albedo = Vector3f::ZERO;
+		objectId = -1;
+		hitCount = 0;
+	}
+
+	bool hit; // primary ray hit something
+	float depth; // ray parameter of the primary hit
+	Vector3f normal; // unit normal at the primary hit
+	Vector3f albedo; // diffuse reflectance at the primary hit
+	int objectId; // index of the primary hit object in the scene group
+	int hitCount; // surface hits in the whole ray tree of the pixel
+	int fields; // Fields to fill
+};
+
+///@brief arbitrary output variable (AOV) images. Every pass shares the
+///samples stored per pixel, so enabling another pass costs no extra rays.
+class AOVBuffers
+{
+public:
+
+	enum Pass { DEPTH, NORMAL, ALBEDO, OBJECT_ID, HIT_COUNT, NUM_PASSES };
+
+	AOVBuffers( int width, int height );
+
+	///@brief requests a pass, written to filename by save()
+	void enable( Pass pass, const char* filename );
+	bool enabled( Pass pass ) const { return filenames[pass] != NULL; }
+	///@brief true if at least one pass was requested
+	bool any() const;
+	///@brief the AOVSample::Fields the requested passes read
+	int fields() const;
+
+	///@brief depths below depth_min map to white, above depth_max to black
+	void setDepthRange( float depth_min, float depth_max );
+
+	///@brief same pixel convention as Image::SetPixel
+	void store( int x, int y, const AOVSample& sample ) {
+		assert( x >= 0 && x < width );
+		assert( y >= 0 && y < height );
+		samples[y * width + x] = sample;
+	}
+
+	///@brief converts and saves every requested pass
+	void save() const;
+
+private:
+
+	Vector3f color( Pass pass, const AOVSample& sample, int max_hits ) const;
+
+	int width, height;
+	float depth_min, depth_max;
+	const char* filenames[NUM_PASSES];
+	std::vector<AOVSample> samples;
+};
+
+#endif // AOV_H
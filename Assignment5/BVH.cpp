@@ -0,0 +1,363 @@
+#include "BVH.h"
+#include "Object3D.h"
+#include "Stats.h"
+
+#include <algorithm>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+#define BVH_STACK 64
+
+void BVH::build(const std::vector<Object3D*>& objs, const std::vector<int>& ids) {
+	/*
+	Description:
+		Builds the hierarchy over the given objects.
+	Arguments:
+		- objs: bounded objects, the BVH does not take ownership.
+		- ids: object ID of each of objs, reported through Hit::objectId.
+	*/
+
+	nodes.clear();
+	objects.clear();
+	this->ids.clear();
+	if (objs.empty()) { return; }
+
+	std::vector<BuildItem> items(objs.size());
+	for (size_t k = 0; k < objs.size(); k++) {
+		objs[k]->getBoundingBox(items[k].box);
+		items[k].center = items[k].box.center();
+		items[k].obj = objs[k];
+		items[k].id = ids[k];
+	}
+
+	nodes.reserve(2 * objs.size());
+	buildNode(items, 0, items.size(), 0);
+
+	// leaves index into objects in build order
+	for (size_t k = 0; k < items.size(); k++) {
+		objects.push_back(items[k].obj);
+		this->ids.push_back(items[k].id);
+	}
+}
+
+int BVH::buildNode(std::vector<BuildItem>& items, int start, int end, int depth) {
+	/*
+	Description:
+		Recursively splits items[start, end) with a binned SAH sweep.
+		Deep (degenerate) branches switch to median splits so that
+		the traversal stack stays bounded.
+	Return:
+		index of the new node.
+	*/
+
+	// declare variables
+	int idx, n, best_axis, best_bin, mid;
+	float best_cost, area;
+	bool median;
+	Box box, cbox;
+
+	idx = nodes.size();
+	nodes.push_back(BVHNode());
+
+	box = Box::empty(); cbox = Box::empty();
+	for (int k = start; k < end; k++) {
+		box.extend(items[k].box);
+		cbox.extend(items[k].center);
+	}
+	n = end - start;
+	nodes[idx].box = box;
+	nodes[idx].start = start;
+	nodes[idx].count = n;
+	nodes[idx].right = -1;
+	nodes[idx].axis = 0;
+
+	if (n <= 2) { return idx; }
+
+	// ------------------------- binned SAH -------------------------
+	// cost = 1 (traversal) + sum over children of area ratio * object count
+	area = box.area() > 0 ? box.area() : 1.f;
+	best_cost = FLT_MAX; best_axis = -1; best_bin = 0;
+	for (int axis = 0; axis < 3; axis++) {
+
+		float extent = cbox.mx[axis] - cbox.mn[axis];
+		if (extent <= 0) { continue; }
+
+		Box bin_box[BVH_BINS];
+		int bin_count[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) { bin_box[b] = Box::empty(); bin_count[b] = 0; }
+
+		for (int k = start; k < end; k++) {
+			int b = std::min(BVH_BINS - 1, int(BVH_BINS * (items[k].center[axis] - cbox.mn[axis]) / extent));
+			bin_box[b].extend(items[k].box);
+			bin_count[b]++;
+		}
+
+		// sweep from the right, then from the left
+		float right_area[BVH_BINS];
+		int right_count[BVH_BINS];
+		Box acc = Box::empty();
+		int cnt = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			acc.extend(bin_box[b]); cnt += bin_count[b];
+			right_area[b] = acc.area(); right_count[b] = cnt;
+		}
+		acc = Box::empty(); cnt = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			acc.extend(bin_box[b]); cnt += bin_count[b];
+			if (cnt == 0 || right_count[b + 1] == 0) { continue; }
+			float cost = 1.f + (acc.area() * cnt + right_area[b + 1] * right_count[b + 1]) / area;
+			if (cost < best_cost) {
+				best_cost = cost; best_axis = axis; best_bin = b;
+			}
+		}
+	}
+	// --------------------------------------------------------------
+
+	median = best_axis < 0 || depth > BVH_STACK / 2;
+	if (median) {
+		// all centers coincide or the tree got too deep, fall back to a median split
+		if (best_axis < 0 && n <= BVH_MAX_LEAF) { return idx; }
+		if (best_axis < 0) { best_axis = 0; }
+		mid = start + n / 2;
+	}
+	else {
+		if (best_cost >= n && n <= BVH_MAX_LEAF) { return idx; } // splitting does not pay off
+
+		float mn = cbox.mn[best_axis], extent = cbox.mx[best_axis] - cbox.mn[best_axis];
+		BuildItem* pivot = std::partition(&items[0] + start, &items[0] + end, [&](const BuildItem& item) {
+			int b = std::min(BVH_BINS - 1, int(BVH_BINS * (item.center[best_axis] - mn) / extent));
+			return b <= best_bin;
+		});
+		mid = pivot - &items[0];
+		if (mid == start || mid == end) { median = true; mid = start + n / 2; }
+	}
+	if (median) {
+		int axis = best_axis;
+		std::nth_element(&items[0] + start, &items[0] + mid, &items[0] + end, [axis](const BuildItem& a, const BuildItem& b) {
+			return a.center[axis] < b.center[axis];
+		});
+	}
+
+	nodes[idx].count = 0;
+	nodes[idx].axis = best_axis;
+	buildNode(items, start, mid, depth + 1); // first child lands at idx + 1
+	int right = buildNode(items, mid, end, depth + 1);
+	nodes[idx].right = right;
+	return idx;
+}
+
+///@brief slab test against [tmin, tmax]
+static bool hitBox(const Box& box, const Vector3f& o, const Vector3f& inv, float tmin, float tmax) {
+	float tnear = tmin, tfar = tmax;
+	for (int dim = 0; dim < 3; dim++) {
+		float t0 = (box.mn[dim] - o[dim]) * inv[dim];
+		float t1 = (box.mx[dim] - o[dim]) * inv[dim];
+		// argument order makes NaNs (ray in the slab plane) drop out
+		tnear = std::max(tnear, std::min(t0, t1));
+		tfar = std::min(tfar, std::max(t0, t1));
+	}
+	// pad for rounding so hits lying on a box face are not lost
+	return tnear <= tfar * 1.0000008f;
+}
+
+bool BVH::intersectFrom(const Ray& r, Hit& h, float tmin, int root) const {
+	/*
+	Description:
+		Closest hit traversal, near child first, culling any node
+		that starts behind the nearest hit so far.
+	Arguments:
+		- root: node to start from, 0 for the whole tree.
+	*/
+
+	if (nodes.empty()) { return false; }
+
+	// declare variables
+	const Vector3f& o = r.getOrigin();
+	const Vector3f& d = r.getDirection();
+	Vector3f inv(1.f / d[0], 1.f / d[1], 1.f / d[2]);
+	int stack[BVH_STACK];
+	int sp = 0, idx = root, visited = 0;
+	bool result = false;
+
+	while (true) {
+		const BVHNode& node = nodes[idx];
+		visited++;
+		if (hitBox(node.box, o, inv, tmin, h.getT())) {
+			if (node.isLeaf()) {
+				for (int k = node.start; k < node.start + node.count; k++) {
+					if (objects[k]->intersect(r, h, tmin)) { h.objectId = ids[k]; result = true; }
+				}
+			}
+			else {
+				int first = idx + 1, second = node.right;
+				if (d[node.axis] < 0) { std::swap(first, second); }
+				stack[sp++] = second;
+				idx = first;
+				continue;
+			}
+		}
+		if (sp == 0) { break; }
+		idx = stack[--sp];
+	}
+	STATS_ADD(nodesVisited, visited);
+	return result;
+}
+
+bool BVH::occludedFrom(const Ray& r, float tmin, float tmax, int root) const {
+	/*
+	Description:
+		Any-hit traversal, returns on the first object that blocks the ray.
+	Arguments:
+		- root: node to start from, 0 for the whole tree.
+	*/
+
+	if (nodes.empty()) { return false; }
+
+	// declare variables
+	const Vector3f& o = r.getOrigin();
+	const Vector3f& d = r.getDirection();
+	Vector3f inv(1.f / d[0], 1.f / d[1], 1.f / d[2]);
+	int stack[BVH_STACK];
+	int sp = 0, idx = root, visited = 0;
+	bool result = false;
+
+	while (!result) {
+		const BVHNode& node = nodes[idx];
+		visited++;
+		if (hitBox(node.box, o, inv, tmin, tmax)) {
+			if (node.isLeaf()) {
+				for (int k = node.start; k < node.start + node.count && !result; k++) {
+					result = objects[k]->occluded(r, tmin, tmax);
+				}
+			}
+			else {
+				stack[sp++] = node.right;
+				idx = idx + 1;
+				continue;
+			}
+		}
+		if (sp == 0) { break; }
+		idx = stack[--sp];
+	}
+	STATS_ADD(nodesVisited, visited);
+	return result;
+}
+
+///@brief index of the lowest set bit of a non-zero lane mask
+static int firstLane(int mask) {
+	int lane = 0;
+	while (!(mask & (1 << lane))) { lane++; }
+	return lane;
+}
+
+int BVH::intersectPacket(const RayPacket& p, int mask, Hit* hits, float tmin) const {
+	/*
+	Description:
+		Closest hit traversal of a packet. Each node is tested against
+		every lane at once; the near child is picked by the first lane
+		that reached the node.
+	Return:
+		mask of the lanes whose hit was updated.
+	*/
+
+	if (nodes.empty() || mask == 0) { return 0; }
+
+	// declare variables
+	float tmax[PACKET_SIZE], tnear[PACKET_SIZE];
+	int stack[BVH_STACK];
+	int sp = 0, idx = 0, visited = 0;
+	int result = 0;
+
+	for (int lane = 0; lane < PACKET_SIZE; lane++) { tmax[lane] = hits[lane].getT(); }
+
+	while (true) {
+		const BVHNode& node = nodes[idx];
+		int m = p.hitBox(node.box, tmin, tmax, tnear) & mask;
+		visited++;
+
+		if (m != 0 && (m & (m - 1)) == 0) {
+			// diverged down to one ray
+			int lane = firstLane(m);
+			if (intersectFrom(*p.ray[lane], hits[lane], tmin, idx)) {
+				result |= m;
+				tmax[lane] = hits[lane].getT();
+			}
+		}
+		else if (m != 0) {
+			if (node.isLeaf()) {
+				for (int k = node.start; k < node.start + node.count; k++) {
+					int hit = objects[k]->intersectPacket(p, m, hits, tmin);
+					for (int lane = 0; lane < PACKET_SIZE; lane++) {
+						if (hit & (1 << lane)) {
+							hits[lane].objectId = ids[k];
+							tmax[lane] = hits[lane].getT();
+						}
+					}
+					result |= hit;
+				}
+			}
+			else {
+				int first = idx + 1, second = node.right;
+				if (p.d[node.axis][firstLane(m)] < 0) { std::swap(first, second); }
+				stack[sp++] = second;
+				idx = first;
+				continue;
+			}
+		}
+		if (sp == 0) { break; }
+		idx = stack[--sp];
+	}
+	STATS_ADD(nodesVisited, visited);
+	return result;
+}
+
+int BVH::occludedPacket(const RayPacket& p, int mask, float tmin, const float* tmax) const {
+	/*
+	Description:
+		Any-hit traversal of a packet; a lane drops out once it is blocked.
+	Return:
+		mask of the occluded lanes.
+	*/
+
+	if (nodes.empty()) { return 0; }
+
+	// declare variables
+	float tnear[PACKET_SIZE];
+	int stack[BVH_STACK];
+	int sp = 0, idx = 0, visited = 0;
+	int result = 0;
+
+	while (mask != 0) {
+		const BVHNode& node = nodes[idx];
+		int m = p.hitBox(node.box, tmin, tmax, tnear) & mask;
+		visited++;
+
+		if (m != 0 && (m & (m - 1)) == 0) {
+			// diverged down to one ray
+			int lane = firstLane(m);
+			if (occludedFrom(*p.ray[lane], tmin, tmax[lane], idx)) {
+				result |= m;
+				mask &= ~m;
+			}
+		}
+		else if (m != 0) {
+			if (node.isLeaf()) {
+				for (int k = node.start; k < node.start + node.count && m != 0; k++) {
+					int blocked = objects[k]->occludedPacket(p, m, tmin, tmax);
+					result |= blocked;
+					mask &= ~blocked;
+					m &= ~blocked;
+				}
+			}
+			else {
+				stack[sp++] = node.right;
+				idx = idx + 1;
+				continue;
+			}
+		}
+		if (sp == 0) { break; }
+		idx = stack[--sp];
+	}
+	STATS_ADD(nodesVisited, visited);
+	return result;
+}
@@ -0,0 +1,70 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "Box.h"
+#include "Ray.h"
+#include "Hit.h"
+#include "RayPacket.h"
+
+class Object3D;
+
+///@brief node of a flattened BVH. Interior nodes keep their first
+///child right after themselves and the second at index right;
+///leaves hold count objects starting at start.
+struct BVHNode
+{
+	Box box;
+	int start, count;
+	int right;
+	///@brief axis the children were split on, picks the near child first
+	int axis;
+	bool isLeaf() const { return count > 0; }
+};
+
+///@brief bounding volume hierarchy over bounded scene objects,
+///built with the surface area heuristic (SAH)
+class BVH
+{
+public:
+
+	BVH() {}
+
+	///@brief objs must all have a bounding box
+	///@param ids object ID written into the hit for each of objs
+	void build(const std::vector<Object3D*>& objs, const std::vector<int>& ids);
+
+	bool intersect(const Ray& r, Hit& h, float tmin) const { return intersectFrom(r, h, tmin, 0); }
+	///@brief any-hit query, see Object3D::occluded
+	bool occluded(const Ray& r, float tmin, float tmax) const { return occludedFrom(r, tmin, tmax, 0); }
+
+	///@brief packet traversal, see Object3D::intersectPacket. A node
+	///reached by a single lane is finished with the single ray traversal.
+	int intersectPacket(const RayPacket& p, int mask, Hit* hits, float tmin) const;
+	int occludedPacket(const RayPacket& p, int mask, float tmin, const float* tmax) const;
+
+	bool empty() const { return nodes.empty(); }
+	const Box& getBox() const { return nodes[0].box; }
+
+private:
+
+	struct BuildItem
+	{
+		Box box;
+		Vector3f center;
+		Object3D* obj;
+		int id;
+	};
+
+	int buildNode(std::vector<BuildItem>& items, int start, int end, int depth);
+
+	///@brief single ray traversal of the subtree under node root
+	bool intersectFrom(const Ray& r, Hit& h, float tmin, int root) const;
+	bool occludedFrom(const Ray& r, float tmin, float tmax, int root) const;
+
+	std::vector<BVHNode> nodes;
+	std::vector<Object3D*> objects;
+	std::vector<int> ids;
+};
+
+#endif // BVH_H
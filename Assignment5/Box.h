@@ -0,0 +1,52 @@
+#ifndef BOX_H
+#define BOX_H
+
+#include <float.h>
+#include <Vector3f.h>
+
+///@brief axis aligned bounding box
+struct Box
+{
+	Vector3f mn, mx;
+	Box(){}
+	Box(const Vector3f & a, const Vector3f & b):
+	mn(a),mx(b)
+	{}
+	Box(float mnx, float mny,float mnz,
+		float mxx,float mxy,float mxz):
+	mn(Vector3f(mnx,mny,mnz)),
+		mx(Vector3f(mxx,mxy,mxz))
+	{}
+
+	///@brief inverted box that any extend() overwrites
+	static Box empty(){
+		return Box(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+	}
+
+	void extend(const Vector3f & p){
+		for(int dim = 0; dim < 3; dim++){
+			if(p[dim] < mn[dim]){ mn[dim] = p[dim]; }
+			if(p[dim] > mx[dim]){ mx[dim] = p[dim]; }
+		}
+	}
+
+	void extend(const Box & b){
+		extend(b.mn);
+		extend(b.mx);
+	}
+
+	Vector3f center() const {
+		return 0.5f * (mn + mx);
+	}
+
+	///@brief surface area, used by the SAH cost
+	float area() const {
+		Vector3f d = mx - mn;
+		if(d[0] < 0 || d[1] < 0 || d[2] < 0){
+			return 0;
+		}
+		return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+	}
+};
+
+#endif // BOX_H
@@ -15,6 +15,11 @@ class Camera
 public:
 	//generate rays for each screen-space coordinate
 	virtual Ray generateRay( const Vector2f& point ) = 0 ; 
+	///@brief also sets the ray's differentials
+	///@param pixel size of one pixel in the units of point
+	virtual Ray generateRay( const Vector2f& point, const Vector2f& /*pixel*/ ) {
+		return generateRay(point);
+	}
 	
 	virtual float getTMin() const = 0 ; 
 	virtual ~Camera(){}
@@ -38,6 +43,7 @@ public:
 		this->u = Vector3f::cross(w, up);
 		this->v = Vector3f::cross(u, w);
 		this->_angle = angle;
+		this->_dist = 1. / tan(_angle / 2.); // distance to the image plane, same for every ray
 		
 	}
 
@@ -45,16 +51,37 @@ public:
 
 		// declaring variables
 		Vector3f r; 
-		float dist;
 		
 		// computing ray direction
-		dist = 1. / tan(_angle / 2.);
-		r = v * point.x() + u * point.y() + dist * w; 
+		r = v * point.x() + u * point.y() + _dist * w; 
 		r.normalize(); 
 		
 		return Ray(this->center, r);
 	}
 
+	virtual Ray generateRay( const Vector2f& point, const Vector2f& pixel ) {
+
+		// declaring variables
+		Vector3f r, drdx, drdy;
+		RayDifferentials diff;
+		float len;
+
+		r = v * point.x() + u * point.y() + _dist * w;
+		drdx = v * pixel.x();
+		drdy = u * pixel.y();
+		len = r.abs();
+
+		// derivative of r / |r|, the origin stays at the centre
+		diff.dOdx = Vector3f::ZERO;
+		diff.dOdy = Vector3f::ZERO;
+		diff.dDdx = (Vector3f::dot(r, r) * drdx - Vector3f::dot(r, drdx) * r) / (len * len * len);
+		diff.dDdy = (Vector3f::dot(r, r) * drdy - Vector3f::dot(r, drdy) * r) / (len * len * len);
+
+		Ray ray = generateRay(point);
+		ray.setDifferentials(diff);
+		return ray;
+	}
+
 	virtual float getTMin() const { 
 		return 0.0f;
 	}
@@ -63,6 +90,7 @@ private:
 
 	Vector3f u, v, w;
 	float _angle;
+	float _dist;
 
 };
 
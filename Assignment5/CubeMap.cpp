@@ -1,62 +1,146 @@
 #include "CubeMap.h"
+#include "bitmap_image.hpp"
+#include <algorithm>
 #include <string>
+#include <cmath>
+
+// directions projected at a time by lookup, kept on the stack
+#define CUBEMAP_CHUNK 64
+
+// how each face maps a direction with major axis `axis` to texture
+// coordinates: u = (d[u_axis] / d[axis] + 1) / 2, mirrored as 1 - u when
+// flip_u is set, likewise for v
+struct FaceAxes
+{
+  int axis, u_axis, v_axis;
+  bool flip_u, flip_v;
+};
+static const FaceAxes face_axes[6] = {
+  { 0, 2, 1, false, true  },  // LEFT   -x
+  { 0, 2, 1, false, false },  // RIGHT  +x
+  { 1, 0, 2, false, false },  // UP     +y
+  { 1, 0, 2, true,  true  },  // DOWN   -y
+  { 2, 0, 1, true,  false },  // FRONT  +z
+  { 2, 0, 1, false, true  }   // BACK   -z
+};
+// face of the positive and negative direction along each axis
+static const int axis_faces[3][2] = {
+  { CubeMap::RIGHT, CubeMap::LEFT }, { CubeMap::UP, CubeMap::DOWN }, { CubeMap::FRONT, CubeMap::BACK } };
+
 CubeMap::CubeMap(const char * directory)
 {
 	std::string suffix[6] = {"left","right","up","down","front","back"};
 	std::string dirname(directory);
+	size_t offset = 0;
+	bitmap_image images[6];
 	for(int ii = 0 ;ii<6;ii++){
 		std::string filename = dirname+"/";
 		filename = filename+suffix[ii];
 		filename = filename +".bmp";
-		t[ii].load(filename.c_str());
+		images[ii] = bitmap_image(filename);
+		faces[ii].width = std::max(0, (int)images[ii].width());
+		faces[ii].height = std::max(0, (int)images[ii].height());
+		faces[ii].offset = offset;
+		offset += 3 * (size_t)faces[ii].width * faces[ii].height;
+	}
+	texels.resize(offset);
+	for(int ii = 0 ;ii<6;ii++){
+		float * texel = &texels[faces[ii].offset];
+		for(int y = 0; y < faces[ii].height; y++){
+			for(int x = 0; x < faces[ii].width; x++, texel += 3){
+				unsigned char r,g,b;
+				images[ii].get_pixel(x,y,r,g,b);
+				texel[0] = r / 255.f; texel[1] = g / 255.f; texel[2] = b / 255.f;
+			}
+		}
 	}
 }
 
-Vector3f CubeMap::operator()(const Vector3f & direction)
+bool CubeMap::project(const float dir[3], int & face, float & u, float & v) const
 {
-  Vector3f dir = direction.normalized();
-  Vector3f outputColor (0.0f,0.0f,0.0f);
-  if ((fabsf(dir[0]) >= fabsf(dir[1])) 
-      && (fabsf(dir[0]) >= fabsf(dir[2])))
+  // the coordinates are ratios, so dir need not be normalized; the
+  // major axis ties go to x, then y, like the original if chain
+  float ax = fabsf(dir[0]), ay = fabsf(dir[1]), az = fabsf(dir[2]);
+  int axis = (ax >= ay && ax >= az) ? 0 : (ay >= az ? 1 : 2);
+  float major = dir[axis];
+  if (!(major > 0.0f || major < 0.0f))
   {
-    if (dir[0] > 0.0f)
-    {
-      outputColor = t[RIGHT]((dir[2] / dir[0]+ 1.0f) * 0.5f, 
-        (dir[1] / dir[0]+ 1.0f) * 0.5f);
-    }
-    else if (dir[0] < 0.0f)
-    {
-      outputColor = t[LEFT]( (dir[2] / dir[0]+ 1.0f) * 0.5f, 
-        1.0-(dir[1] / dir[0]+ 1.0f) * 0.5f);
-    }
+    return false;
   }
-  else if ((fabsf(dir[1]) >= fabsf(dir[0])) && (fabsf(dir[1]) >= fabsf(dir[2])))
+  face = axis_faces[axis][major < 0.0f];
+  const FaceAxes & f = face_axes[face];
+  float inv = 1.0f / major;
+  u = (dir[f.u_axis] * inv + 1.0f) * 0.5f;
+  v = (dir[f.v_axis] * inv + 1.0f) * 0.5f;
+  if (f.flip_u) u = 1.0f - u;
+  if (f.flip_v) v = 1.0f - v;
+  return true;
+}
+
+void CubeMap::bilinear(int face, float u, float v, float color[3]) const
+{
+  // same filtering as Texture::operator(), clamped at the face edges
+  const Face & f = faces[face];
+  if (f.width <= 0 || f.height <= 0)
   {
-    if (dir[1] > 0.0f)
-    {
-       outputColor = t[UP]((dir[0] / dir[1]+ 1.0f) * 0.5f, 
-        (dir[2] / dir[1]+ 1.0f) * 0.5f);
-    }
-    else if (dir[1] < 0.0f)
-    {
-       outputColor = t[DOWN](1.0f-(dir[0] / dir[1]+ 1.0f) * 0.5f, 
-        1.0f - (dir[2] / dir[1]+ 1.0f) * 0.5f);
-    }
+    color[0] = color[1] = color[2] = 0.0f;
+    return;
+  }
+  float x = u * f.width, y = (1 - v) * f.height;
+  int ix = (int)x, iy = (int)y;
+  float alpha = x - ix, beta = y - iy;
+  int x0 = std::min(std::max(ix, 0), f.width - 1), x1 = std::min(std::max(ix + 1, 0), f.width - 1);
+  int y0 = std::min(std::max(iy, 0), f.height - 1), y1 = std::min(std::max(iy + 1, 0), f.height - 1);
+  const float * base = &texels[f.offset];
+  const float * p00 = base + 3 * (y0 * f.width + x0), * p10 = base + 3 * (y0 * f.width + x1);
+  const float * p01 = base + 3 * (y1 * f.width + x0), * p11 = base + 3 * (y1 * f.width + x1);
+  float w00 = (1 - alpha) * (1 - beta), w10 = alpha * (1 - beta);
+  float w01 = (1 - alpha) * beta, w11 = alpha * beta;
+  for (int ii = 0; ii < 3; ii++)
+  {
+    color[ii] = w00 * p00[ii] + w10 * p10[ii] + w01 * p01[ii] + w11 * p11[ii];
   }
-  else if ((fabsf(dir[2]) >= fabsf(dir[0])) 
-           && (fabsf(dir[2]) >= fabsf(dir[1])))
+}
+
+Vector3f CubeMap::operator()(const Vector3f & direction) const
+{
+  const float dir[3] = { direction.x(), direction.y(), direction.z() };
+  float color[3] = { 0.0f, 0.0f, 0.0f };
+  int face;
+  float u, v;
+  if (project(dir, face, u, v))
   {
-    if (dir[2] > 0.0f)
+    bilinear(face, u, v, color);
+  }
+  return Vector3f(color[0], color[1], color[2]);
+}
+
+void CubeMap::lookup(const Vector3f * directions, int count, Vector3f * colors) const
+{
+  // faces and coordinates first, then the texel fetches back to back,
+  // a chunk at a time so nothing is allocated
+  int face[CUBEMAP_CHUNK];
+  float u[CUBEMAP_CHUNK], v[CUBEMAP_CHUNK];
+  for (int start = 0; start < count; start += CUBEMAP_CHUNK)
+  {
+    int n = std::min(count - start, CUBEMAP_CHUNK);
+    for (int k = 0; k < n; k++)
     {
-        outputColor = t[FRONT](1.0f - (dir[0] / dir[2]+ 1.0f) * 0.5f, 
-        (dir[1] / dir[2]+ 1.0f) * 0.5f);
-	}
-    else if (dir[2] < 0.0f)
+      const Vector3f & d = directions[start + k];
+      const float dir[3] = { d.x(), d.y(), d.z() };
+      if (!project(dir, face[k], u[k], v[k]))
+      {
+        face[k] = -1;
+      }
+    }
+    for (int k = 0; k < n; k++)
     {
-       outputColor = t[BACK]((dir[0] / dir[2]+ 1.0f) * 0.5f, 
-        1.0f-(dir[1] / dir[2]+ 1.0f) * 0.5f);
+      float color[3] = { 0.0f, 0.0f, 0.0f };
+      if (face[k] >= 0)
+      {
+        bilinear(face[k], u[k], v[k], color);
+      }
+      colors[start + k] = Vector3f(color[0], color[1], color[2]);
     }
   }
-
-  return outputColor;
-}
\ No newline at end of file
+}
@@ -1,7 +1,11 @@
 #ifndef CUBEMAP_H
 #define CUBEMAP_H
-#include "texture.hpp"
+#include <cstddef>
+#include <vector>
 #include "Vector3f.h"
+///@brief environment map from six square-ish bitmaps. All faces are
+///converted at load time into one float array (rgb in 0-1), so a lookup
+///is a face pick from a small table and one bilinear fetch.
 class CubeMap{
 public:
 ///@brief assumes a directory containing
@@ -11,8 +15,25 @@ enum FACE
 {
 	LEFT,RIGHT,UP,DOWN,FRONT,BACK
 };
-Vector3f operator()(const Vector3f&);
-Texture t[6];
+///@brief colour seen along direction, which need not be normalized
+Vector3f operator()(const Vector3f&) const;
+///@brief operator() for count directions, the faces and texture
+///coordinates are worked out for all of them before any texel is read
+void lookup(const Vector3f * directions, int count, Vector3f * colors) const;
 
+private:
+///@brief face and texture coordinates (0-1, v up) for direction
+///@return false for a zero or NaN direction
+bool project(const float direction[3], int & face, float & u, float & v) const;
+void bilinear(int face, float u, float v, float color[3]) const;
+
+struct Face
+{
+	int width, height;
+	size_t offset; // first texel in texels
+};
+Face faces[6];
+// rgb texels of every face, face after face, rows top down
+std::vector<float> texels;
 };
-#endif
\ No newline at end of file
+#endif
@@ -5,13 +5,15 @@
 #include "Object3D.h"
 #include "Ray.h"
 #include "Hit.h"
+#include "BVH.h"
 #include <iostream>
+#include <vector>
 
 using  namespace std;
 
-///TODO: 
-///Implement Group
-///Add data structure to store a list of Object* 
+///@brief list of objects. Bounded objects are found through an SAH BVH
+///built by buildBVH(), unbounded ones (planes) are kept in a side list
+///and tested linearly.
 class Group:public Object3D
 {
 public:
@@ -30,17 +32,76 @@ public:
 	  bool flag; 
 
 	  flag = false; // init intersect flag to false
-	  // loop over all objects
-	  for (int i = 0; i < objects.size(); i++) {
+	  // unbounded objects first, a near plane hit lets the BVH cull more
+	  for (size_t i = 0; i < unbounded.size(); i++) {
 
 		  // set flag to true if intersection occurs
-		  if (objects[i]->intersect(r, h, tmin)) { 
+		  if (unbounded[i]->intersect(r, h, tmin)) { 
+			  h.objectId = unbounded_ids[i];
 			  flag = true;
 		  }
 	  }
+	  if (bvh.intersect(r, h, tmin)) {
+		  flag = true;
+	  }
 
 	  return flag;
    }
+
+  virtual bool occluded( const Ray& r , float tmin , float tmax ) {
+	  for (size_t i = 0; i < unbounded.size(); i++) {
+		  if (unbounded[i]->occluded(r, tmin, tmax)) {
+			  return true;
+		  }
+	  }
+	  return bvh.occluded(r, tmin, tmax);
+  }
+
+  virtual int intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin ) {
+	  int result = 0;
+	  for (size_t i = 0; i < unbounded.size(); i++) {
+		  int hit = unbounded[i]->intersectPacket(p, mask, hits, tmin);
+		  for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			  if (hit & (1 << lane)) { hits[lane].objectId = unbounded_ids[i]; }
+		  }
+		  result |= hit;
+	  }
+	  return result | bvh.intersectPacket(p, mask, hits, tmin);
+  }
+
+  virtual int occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax ) {
+	  int result = 0;
+	  for (size_t i = 0; i < unbounded.size() && mask != 0; i++) {
+		  int blocked = unbounded[i]->occludedPacket(p, mask, tmin, tmax);
+		  result |= blocked;
+		  mask &= ~blocked;
+	  }
+	  return result | bvh.occludedPacket(p, mask, tmin, tmax);
+  }
+
+  virtual bool getBoundingBox( Box& box ) const {
+	  if (!unbounded.empty() || bvh.empty()) {
+		  return false;
+	  }
+	  box = bvh.getBox();
+	  return true;
+  }
+
+  ///@brief sorts the objects into the BVH and the unbounded list,
+  ///call once all objects are added. Hits are tagged with the index of
+  ///the object in this group (the outermost group wins for nested ones).
+  void buildBVH() {
+	  std::vector<Object3D*> bounded;
+	  std::vector<int> bounded_ids;
+	  Box box;
+	  unbounded.clear();
+	  unbounded_ids.clear();
+	  for (size_t i = 0; i < objects.size(); i++) {
+		  if (objects[i]->getBoundingBox(box)) { bounded.push_back(objects[i]); bounded_ids.push_back(i); }
+		  else { unbounded.push_back(objects[i]); unbounded_ids.push_back(i); }
+	  }
+	  bvh.build(bounded, bounded_ids);
+  }
 	
   void addObject( int index , Object3D* obj ) {
 	  this->objects.push_back(obj);
@@ -52,6 +113,9 @@ public:
 
  private:
 	 std::vector<Object3D*> objects;
+	 std::vector<Object3D*> unbounded;
+	 std::vector<int> unbounded_ids;
+	 BVH bvh;
 };
 
 #endif
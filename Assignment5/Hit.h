@@ -4,8 +4,16 @@
 #include <vecmath.h>
 #include "Ray.h"
 #include <float.h>
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// Transforms kept in the hit itself, deeper nesting goes to the heap
+#define HIT_MAX_TRANSFORMS 8
 
 class Material;
+class Object3D;
+class Transform;
 
 class Hit
 {
@@ -16,6 +24,10 @@ public:
         material = NULL;
 		t = FLT_MAX;
 		hasTex = false;
+		objectId = -1;
+		object = NULL;
+		primitive = -1;
+		numTransforms = 0;
     }
 
     Hit( float _t, Material* m, const Vector3f& n ) { 
@@ -23,6 +35,10 @@ public:
         material = m;
         normal = n;
 		hasTex = false;
+		objectId = -1;
+		object = NULL;
+		primitive = -1;
+		numTransforms = 0;
     }
 
     Hit( const Hit& h ) { 
@@ -30,6 +46,16 @@ public:
         material = h.material; 
         normal = h.normal;
 		hasTex=h.hasTex;
+		texCoord=h.texCoord;
+		texDx=h.texDx;
+		texDy=h.texDy;
+		objectId=h.objectId;
+		object=h.object;
+		primitive=h.primitive;
+		for (int k = 0; k < 3; k++) { bary[k] = h.bary[k]; }
+		numTransforms=h.numTransforms;
+		for (int k = 0; k < std::min(numTransforms, HIT_MAX_TRANSFORMS); k++) { transforms[k] = h.transforms[k]; }
+		deepTransforms=h.deepTransforms;
     }
 
     ~Hit() {} // destructor
@@ -51,19 +77,80 @@ public:
         material = m;
         normal = n;
     }
+
+	void setMaterial( Material* m ) {
+		material = m;
+	}
+
+	///@brief keeps a nearer hit found during traversal: only t, the
+	///primitive and its barycentrics. The material, normal and texture
+	///coordinates are left to finalizeHit, once the nearest hit is known.
+	void record( float _t, const Object3D* obj, int prim, float alpha, float beta, float gamma ) {
+		t = _t;
+		object = obj;
+		primitive = prim;
+		bary[0] = alpha; bary[1] = beta; bary[2] = gamma;
+		numTransforms = 0;
+		deepTransforms.clear();
+	}
+	///@brief called by each Transform above the primitive that recorded
+	///the hit, innermost first
+	void pushTransform( const Transform* transform ) {
+		if (numTransforms < HIT_MAX_TRANSFORMS) { transforms[numTransforms] = transform; }
+		else { deepTransforms.push_back(transform); }
+		numTransforms++;
+	}
+	int getNumTransforms() const {
+		return numTransforms;
+	}
+	///@brief Transform number k above the hit, 0 being the innermost
+	const Transform* getTransform( int k ) const {
+		return k < HIT_MAX_TRANSFORMS ? transforms[k] : deepTransforms[k - HIT_MAX_TRANSFORMS];
+	}
+	const Object3D* getObject() const {
+		return object;
+	}
+	int getPrimitive() const {
+		return primitive;
+	}
+	///@brief weights of the primitive's three vertices
+	const float* getBarycentrics() const {
+		return bary;
+	}
 	void setTexCoord(const Vector2f & coord) {
 		texCoord = coord;
 		hasTex = true;
+		texDx = Vector2f::ZERO;
+		texDy = Vector2f::ZERO;
+	}
+	///@brief how the texture coordinate changes per pixel step in x and y
+	void setTexDifferentials(const Vector2f & dx, const Vector2f & dy) {
+		texDx = dx;
+		texDy = dy;
+	}
+	///@brief width of the pixel's footprint in texture coordinates, 0 if unknown
+	float getTexFootprint() const {
+		return max(texDx.abs(), texDy.abs());
 	}
 
 	// declare variables
 	bool hasTex;
 	Vector2f texCoord;
+	Vector2f texDx, texDy; // zero unless the ray had differentials
+	int objectId; // index of the hit object in the scene group, -1 if unknown
 
 private:
+	// Transforms between the scene and the hit primitive, innermost first;
+	// past HIT_MAX_TRANSFORMS they continue in deepTransforms
+	const Transform* transforms[HIT_MAX_TRANSFORMS];
+	std::vector<const Transform*> deepTransforms;
+	int numTransforms;
 	float t;
     Material* material;
     Vector3f normal;
+	const Object3D* object; // primitive that recorded the hit, NULL if set directly
+	int primitive; // e.g. triangle index within a mesh
+	float bary[3];
 
 };
 
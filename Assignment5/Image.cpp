@@ -313,6 +313,61 @@ Image::SaveBMP(const char *filename)
     return(1);
 }
 
+Image*
+Image::LoadBMP(const char *filename)
+{
+    int i, j, ipos;
+    int bytesPerLine;
+    unsigned char *line;
+    unsigned char header[54];
+    int width, height;
+    short bitCount;
+    FILE *file;
+    Image *answer;
+
+    file = fopen (filename, "rb");
+    if (file == NULL) return(NULL);
+
+    if (fread(header, 54, 1, file) != 1 || header[0] != 'B' || header[1] != 'M')
+    {
+        fclose(file);
+        return(NULL);
+    }
+    memcpy(&width, header + 18, 4);
+    memcpy(&height, header + 22, 4);
+    memcpy(&bitCount, header + 28, 2);
+    if (width <= 0 || height <= 0 || bitCount != 24)
+    {
+        fclose(file);
+        return(NULL);
+    }
+
+    /* same line padding as SaveBMP */
+    bytesPerLine = (3 * (width + 1) / 4) * 4;
+    line = (unsigned char *)malloc(bytesPerLine);
+    answer = new Image(width, height);
+
+    for (i = 0; i < height ; i++)
+    {
+        if (fread(line, bytesPerLine, 1, file) != 1)
+        {
+            delete answer;
+            answer = NULL;
+            break;
+        }
+        for (j = 0; j < width; j++)
+        {
+            ipos = (width * i + j);
+            answer->data[ipos] = Vector3f(line[3*j+2] / 255.0, line[3*j+1] / 255.0, line[3*j] / 255.0);
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    return(answer);
+}
+
 void Image::SaveImage(const char * filename)
 {
 	int len = strlen(filename);
@@ -60,6 +60,8 @@ public:
     static Image* LoadTGA( const char* filename );
     void SaveTGA( const char* filename ) const; 
 	int SaveBMP(const char *filename);
+	///@brief reads the 24 bit files written by SaveBMP, NULL on failure
+	static Image* LoadBMP(const char *filename);
 	void SaveImage(const char *filename);
     // extension for image comparison
     static Image* compare( Image* img1, Image* img2 );
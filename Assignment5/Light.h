@@ -61,11 +61,14 @@ class PointLight : public Light
 {
 public:
 
-    PointLight( const Vector3f& p, const Vector3f& c,float fall )
+    ///@param rad influence radius: the light fades smoothly to nothing
+    ///there and is skipped beyond it; 0 lights the whole scene
+    PointLight( const Vector3f& p, const Vector3f& c,float fall, float rad = 0 )
     {
         position = p;
         color = c;
       falloff = fall;
+      radius = rad;
     }
 
     ~PointLight()
@@ -81,12 +84,31 @@ public:
       distanceToLight = dir.abs();
 		  dir = dir/dir.abs();
       col = color/(1+falloff*distanceToLight*distanceToLight);
+      if (radius > 0) {
+        col = col*window(distanceToLight);
+      }
     }
 
+    ///@brief (1 - (d/radius)^4)^2, 1 at the light and 0 from the radius
+    ///on, with a smooth end so the cutoff leaves no visible edge
+    float window( float distanceToLight ) const
+    {
+      float x = distanceToLight/radius;
+      x = x*x;
+      x = 1 - x*x;
+      return x > 0 ? x*x : 0;
+    }
+
+    const Vector3f& getPosition() const { return position; }
+    const Vector3f& getColor() const { return color; }
+    float getFalloff() const { return falloff; }
+    float getRadius() const { return radius; }
+
 private:
 
     PointLight(); // don't use
     float falloff;
+    float radius;
     Vector3f position;
     Vector3f color;
 
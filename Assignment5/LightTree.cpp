@@ -0,0 +1,228 @@
+#include "LightTree.h"
+#include "Light.h"
+#include "Random.h"
+
+#include <algorithm>
+
+#define LIGHT_TREE_STACK 64
+
+///@brief squared distance from p to the box, 0 inside
+static float squaredDistance( const Box& box, const Vector3f& p ) {
+	float d2 = 0.f;
+	for (int dim = 0; dim < 3; dim++) {
+		float d = std::max(0.f, std::max(box.mn[dim] - p[dim], p[dim] - box.mx[dim]));
+		d2 += d * d;
+	}
+	return d2;
+}
+
+static bool contains( const Box& box, const Vector3f& p ) {
+	return p[0] >= box.mn[0] && p[0] <= box.mx[0] && p[1] >= box.mn[1] && p[1] <= box.mx[1]
+		&& p[2] >= box.mn[2] && p[2] <= box.mx[2];
+}
+
+static bool byLight( const LightSample& a, const LightSample& b ) {
+	return a.light < b.light;
+}
+
+void LightTree::build(Light* const* lights, int num_lights) {
+	/*
+	Description:
+		Puts the point lights into a tree split at the median of the
+		longest axis, one light per leaf; every other light goes to the
+		global list.
+	Arguments:
+		- lights: the scene lights, num_lights of them.
+	*/
+
+	// declare variables
+	std::vector<BuildItem> items;
+
+	nodes.clear();
+	global.clear();
+	bounded = false;
+	for (int k = 0; k < num_lights; k++) {
+		PointLight* point = dynamic_cast<PointLight*>(lights[k]);
+		if (point == NULL) {
+			global.push_back(k);
+			continue;
+		}
+		BuildItem item;
+		item.position = point->getPosition();
+		item.light = k;
+		items.push_back(item);
+		bounded = bounded || point->getRadius() > 0;
+	}
+	if (items.empty()) { return; }
+
+	nodes.reserve(2 * items.size());
+	buildNode(items, 0, items.size(), lights);
+}
+
+int LightTree::buildNode(std::vector<BuildItem>& items, int start, int end, Light* const* lights) {
+	/*
+	Description:
+		Recursively splits items[start, end) and sums up the children.
+	Return:
+		index of the new node.
+	*/
+
+	// declare variables
+	int idx, axis, mid, left;
+	Vector3f extent;
+
+	idx = nodes.size();
+	nodes.push_back(LightNode());
+
+	if (end - start == 1) {
+		const PointLight* point = static_cast<const PointLight*>(lights[items[start].light]);
+		const Vector3f& c = point->getColor();
+		float r = point->getRadius();
+		LightNode& leaf = nodes[idx];
+		leaf.bounds = Box(point->getPosition(), point->getPosition());
+		leaf.influence = r > 0 ? Box(point->getPosition() - Vector3f(r, r, r), point->getPosition() + Vector3f(r, r, r))
+			: Box(-FLT_MAX, -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
+		leaf.power = std::max(c[0], std::max(c[1], c[2]));
+		leaf.falloff = point->getFalloff();
+		leaf.radius = r;
+		leaf.light = items[start].light;
+		leaf.right = -1;
+		return idx;
+	}
+
+	Box cbox = Box::empty();
+	for (int k = start; k < end; k++) { cbox.extend(items[k].position); }
+	extent = cbox.mx - cbox.mn;
+	axis = extent[0] >= extent[1] && extent[0] >= extent[2] ? 0 : extent[1] >= extent[2] ? 1 : 2;
+	mid = (start + end) / 2;
+	std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+		[axis](const BuildItem& a, const BuildItem& b) { return a.position[axis] < b.position[axis]; });
+
+	left = buildNode(items, start, mid, lights);
+	int right = buildNode(items, mid, end, lights);
+
+	// push_back may have moved the nodes
+	LightNode& node = nodes[idx];
+	node.bounds = nodes[left].bounds; node.bounds.extend(nodes[right].bounds);
+	node.influence = nodes[left].influence; node.influence.extend(nodes[right].influence);
+	node.power = nodes[left].power + nodes[right].power;
+	node.falloff = std::min(nodes[left].falloff, nodes[right].falloff);
+	node.radius = 0.f;
+	node.light = -1;
+	node.right = right;
+	return idx;
+}
+
+float LightTree::importance(const LightNode& node, const Vector3f& p) const {
+	/*
+	Description:
+		Estimated colour (largest channel) the lights under node add at p,
+		leaving out the surface: the falloff at the nearest point of the
+		node and nothing outside its influence.
+	*/
+
+	if (!contains(node.influence, p)) { return 0.f; }
+	float d2 = squaredDistance(node.bounds, p);
+	float estimate = node.power / (1.f + node.falloff * d2);
+	if (node.isLeaf() && node.radius > 0) {
+		float x = d2 / (node.radius * node.radius);
+		x = 1.f - x * x;
+		estimate *= x > 0 ? x * x : 0.f;
+	}
+	return estimate;
+}
+
+void LightTree::gather(const Vector3f& p, std::vector<LightSample>& out) const {
+	/*
+	Description:
+		Walks down every node whose influence box holds p.
+	Arguments:
+		- out: receives the lights, cleared first.
+	*/
+
+	// declare variables
+	int stack[LIGHT_TREE_STACK];
+	int top = 0;
+	LightSample s;
+
+	out.clear();
+	s.weight = 1.f;
+	for (size_t k = 0; k < global.size(); k++) {
+		s.light = global[k];
+		out.push_back(s);
+	}
+	if (!nodes.empty()) { stack[top++] = 0; }
+	while (top > 0) {
+		const LightNode& node = nodes[stack[--top]];
+		if (!contains(node.influence, p)) { continue; }
+		if (node.isLeaf()) {
+			Vector3f d = p - node.bounds.mn;
+			if (node.radius <= 0 || Vector3f::dot(d, d) < node.radius * node.radius) {
+				s.light = node.light;
+				out.push_back(s);
+			}
+			continue;
+		}
+		stack[top++] = node.right;
+		stack[top++] = &node - &nodes[0] + 1;
+	}
+	std::sort(out.begin(), out.end(), byLight);
+}
+
+void LightTree::sample(const Vector3f& p, int count, PixelRandom& random, std::vector<LightSample>& out) const {
+	/*
+	Description:
+		Each pick walks from the root to a leaf, going to either child
+		with probability proportional to its importance at p, and is
+		weighted by one over count times the probability of the path, so
+		the sum over the picks estimates the sum over every light.
+	Arguments:
+		- count: number of picks.
+		- random: draws the picks.
+		- out: receives the lights, cleared first.
+	*/
+
+	// declare variables
+	LightSample s;
+
+	out.clear();
+	s.weight = 1.f;
+	for (size_t k = 0; k < global.size(); k++) {
+		s.light = global[k];
+		out.push_back(s);
+	}
+	for (int pick = 0; pick < count && !nodes.empty(); pick++) {
+		int idx = 0;
+		float probability = 1.f;
+		if (importance(nodes[0], p) <= 0.f) { break; } // no light reaches p
+		while (!nodes[idx].isLeaf() && probability > 0.f) {
+			float left = importance(nodes[idx + 1], p);
+			float right = importance(nodes[nodes[idx].right], p);
+			float total = left + right;
+			if (total <= 0.f) {
+				probability = 0.f; // p is in the node's box but out of reach of both children
+			}
+			else if (random.uniform() * total < left) {
+				probability *= left / total;
+				idx = idx + 1;
+			}
+			else {
+				probability *= right / total;
+				idx = nodes[idx].right;
+			}
+		}
+		if (probability <= 0.f) { continue; }
+		s.light = nodes[idx].light;
+		s.weight = 1.f / (count * probability);
+		out.push_back(s);
+	}
+
+	// one entry per light, so each is shaded and shadow tested once
+	std::sort(out.begin(), out.end(), byLight);
+	size_t n = 0;
+	for (size_t k = 0; k < out.size(); k++) {
+		if (n > 0 && out[n - 1].light == out[k].light) { out[n - 1].weight += out[k].weight; }
+		else { out[n++] = out[k]; }
+	}
+	out.resize(n);
+}
@@ -0,0 +1,77 @@
+#ifndef LIGHT_TREE_H
+#define LIGHT_TREE_H
+
+#include <vector>
+#include "Box.h"
+
+class Light;
+class PixelRandom;
+
+///@brief a light chosen for a shading point, and what its colour is
+///multiplied by: 1 when every light is evaluated, 1 / (count * probability)
+///when it was sampled
+struct LightSample
+{
+	int light;
+	float weight;
+};
+
+///@brief node of a flattened light tree. Interior nodes keep their first
+///child right after themselves and the second at index right; leaves
+///hold one point light.
+struct LightNode
+{
+	Box bounds; // light positions
+	Box influence; // where the lights can reach, unbounded without a radius
+	float power; // sum of the largest colour channel of the lights
+	float falloff; // smallest falloff, so the estimate is an upper bound
+	float radius; // leaves: influence radius, 0 for none
+	int light; // leaves: index into the scene lights, -1 otherwise
+	int right;
+	bool isLeaf() const { return light >= 0; }
+};
+
+///@brief hierarchy over the point lights of a scene. gather() finds the
+///lights whose influence radius reaches a point without looking at the
+///others; sample() picks a few of them with probability proportional to
+///their estimated contribution. Other lights (directional) reach every
+///point and are always returned.
+class LightTree
+{
+public:
+
+	LightTree() : bounded(false) {}
+
+	///@brief the tree keeps indices into lights, not the lights
+	void build(Light* const* lights, int num_lights);
+
+	///@brief true if some point light has an influence radius, so that
+	///gather() can leave lights out
+	bool culls() const { return bounded; }
+
+	///@brief every light that can reach p, in scene order, with weight 1
+	void gather(const Vector3f& p, std::vector<LightSample>& out) const;
+
+	///@brief the lights that are not in the tree and count picks from it,
+	///in scene order; a light picked twice is returned once with both weights
+	void sample(const Vector3f& p, int count, PixelRandom& random, std::vector<LightSample>& out) const;
+
+private:
+
+	struct BuildItem
+	{
+		Vector3f position;
+		int light;
+	};
+
+	int buildNode(std::vector<BuildItem>& items, int start, int end, Light* const* lights);
+
+	///@brief upper bound of what the lights under node add at p, exact on leaves
+	float importance(const LightNode& node, const Vector3f& p) const;
+
+	std::vector<LightNode> nodes;
+	std::vector<int> global; // lights outside the tree
+	bool bounded;
+};
+
+#endif // LIGHT_TREE_H
@@ -11,24 +11,46 @@ Material::~Material() {
 Vector3f Material::getDiffuseColor() const 
 { return  diffuseColor;}
 
-Vector3f Material::Shade( const Ray& ray, const Hit& hit, const Vector3f& dirToLight, const Vector3f& lightColor ) {
+Vector3f Material::getAlbedo( const Ray& ray, const Hit& hit ) {
     Vector3f kd;
 
 	if(t.valid() && hit.hasTex){
 		Vector2f texCoord = hit.texCoord;
-		Vector3f texColor = t(texCoord[0],texCoord[1]);
+		Vector3f texColor = t.sample(texCoord[0],texCoord[1],hit.getTexFootprint());
 		kd = texColor;
 	}
 	else{
 		kd = this->diffuseColor;
     }
-	Vector3f n = hit.getNormal().normalized();
-
-	//Diffuse Shading
 	if(noise.valid()){
 		kd = noise.getColor(ray.getOrigin()+ray.getDirection()*hit.getT());
 	}
+	return kd;
+}
+
+void Material::getAlbedos( const Ray* const* rays, const Hit* const* hits, int count, Vector3f* albedos ) {
+	if(!noise.valid()){
+		for(int k = 0; k < count; k++){
+			albedos[k] = getAlbedo(*rays[k], *hits[k]);
+		}
+		return;
+	}
+	// noise replaces the texture and the diffuse colour
+	std::vector<Vector3f> points(count);
+	for(int k = 0; k < count; k++){
+		points[k] = rays[k]->getOrigin()+rays[k]->getDirection()*hits[k]->getT();
+	}
+	noise.getColors(points.data(), count, albedos);
+}
 
+Vector3f Material::Shade( const Ray& ray, const Hit& hit, const Vector3f& dirToLight, const Vector3f& lightColor ) {
+	return Shade(ray, hit, dirToLight, lightColor, getAlbedo(ray, hit));
+}
+
+Vector3f Material::Shade( const Ray& /*ray*/, const Hit& hit, const Vector3f& dirToLight, const Vector3f& lightColor, const Vector3f& kd ) {
+	Vector3f n = hit.getNormal().normalized();
+
+	//Diffuse Shading
 	Vector3f color = clampedDot( dirToLight ,n )*pointwiseDot( lightColor , kd);
 	return color;
 }
@@ -58,3 +80,9 @@ Vector3f Material::getSpecularColor() {
 void Material::setNoise(const Noise & n) {
 	noise = n;
 }
+
+void Material::bakeNoise(const Box & box) {
+	if(noise.valid() && noise.bakeResolution > 0 && box.mn[0] <= box.mx[0]){
+		noise.bake(box);
+	}
+}
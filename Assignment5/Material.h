@@ -19,6 +19,15 @@ public:
     virtual Vector3f getDiffuseColor() const ;
 
     Vector3f Shade( const Ray& ray, const Hit& hit, const Vector3f& dirToLight, const Vector3f& lightColor ) ;
+	///@brief Shade with the albedo already looked up, so a hit lit by
+	///several lights evaluates its texture or noise once
+	Vector3f Shade( const Ray& ray, const Hit& hit, const Vector3f& dirToLight, const Vector3f& lightColor, const Vector3f& albedo ) ;
+
+	///@brief diffuse reflectance at the hit point (texture, noise or flat colour)
+	Vector3f getAlbedo( const Ray& ray, const Hit& hit );
+	///@brief getAlbedo for count hits of this material, noise is
+	///evaluated for all of them in one batch
+	void getAlbedos( const Ray* const* rays, const Hit* const* hits, int count, Vector3f* albedos );
 
 	static  Vector3f pointwiseDot( const Vector3f& v1 , const Vector3f& v2 );
 
@@ -29,6 +38,8 @@ public:
 	Vector3f getSpecularColor();
 
 	void setNoise(const Noise & n);
+	///@brief bakes the noise over box if the scene asked for it
+	void bakeNoise(const Box & box);
 
 protected:
 
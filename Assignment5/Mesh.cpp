@@ -1,18 +1,26 @@
 #include "Mesh.hpp"
-#include <fstream>
+#include "../common/ObjLoader.h"
 #include <iostream>
 #include <algorithm>
 #include <cstdlib>
 #include <utility>
-#include <sstream>
+#include <chrono>
 
 #define SMOOTH (v.size()>120)
 
-void intersectCall(int idx, void ** arg)
+void intersectCall(const OctNode & leaf, OctreeQuery & q)
 {
-	Mesh * m = (Mesh*)(arg[0]);
-	bool result = m->intersectTrig(idx);
-	arg[1] = (void*)(((bool)arg[1])|result);
+	if(q.mesh->intersectLeaf(leaf, *q.ray, *q.hit, q.tmin)){
+		q.result = true;
+		q.tmax = q.hit->getT();
+	}
+}
+void occludedCall(const OctNode & leaf, OctreeQuery & q)
+{
+	if(q.mesh->occludedLeaf(leaf, *q.ray, q.tmin, q.tmax)){
+		q.result = true;
+		q.done = true;
+	}
 }
 bool Mesh::intersect( const Ray& r , Hit& h , float tmin )
 {
@@ -34,106 +42,217 @@ bool Mesh::intersect( const Ray& r , Hit& h , float tmin )
 	}
 	return result;
 	*/
-	ray = &r;
-	hit = &h;
-	tm = tmin;
-	void * arg[2];
-	arg[0] = this;
-	arg[1] = 0;
-	octree.arg = arg;
-	octree.termFunc = intersectCall;
-	octree.intersect(r);
-	return arg[1];
+	OctreeQuery q;
+	q.mesh = this;
+	q.ray = &r;
+	q.hit = &h;
+	q.tmin = tmin;
+	q.tmax = h.getT();
+	q.result = false;
+	q.nodesVisited = q.leavesVisited = q.leavesSkipped = 0;
+	q.trigsTested = q.trigsSkipped = 0;
+	q.termFunc = intersectCall;
+	octree.intersect(q);
+	q.addStats();
+	return q.result;
 }
-bool Mesh ::intersectTrig(int idx){
-	bool result = false;
-	Triangle triangle(v[t[idx][0]],
-		v[t[idx][1]],v[t[idx][2]],material);
-	
-  //some shitty hack
-//change at will
-if(SMOOTH){
-
-    for(int jj=0;jj<3;jj++){
-		  triangle.normals[jj] = n[t[idx][jj]];
-	  }
-	}else{
-    
-    for(int jj=0;jj<3;jj++){
-		  triangle.normals[jj] = n[idx];
-	  }
+bool Mesh::occluded( const Ray& r , float tmin , float tmax )
+{
+	OctreeQuery q;
+	q.mesh = this;
+	q.ray = &r;
+	q.hit = NULL;
+	q.tmin = tmin;
+	q.tmax = tmax;
+	q.result = false;
+	q.nodesVisited = q.leavesVisited = q.leavesSkipped = 0;
+	q.trigsTested = q.trigsSkipped = 0;
+	q.termFunc = occludedCall;
+	octree.intersect(q);
+	q.addStats();
+	return q.result;
 }
-  if(texCoord.size()>0){
-		for(int jj=0;jj<3;jj++){
-			triangle.texCoords[jj] = texCoord[t[idx].texID[jj]];
-		}
-		triangle.hasTex=true;
+int Mesh::intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin )
+{
+	if(mask == 0){
+		return 0;
 	}
-	result = triangle.intersect( *ray , *hit , tm);
-	return result;
+	if(!p.coherent(mask)){
+		return Object3D::intersectPacket(p, mask, hits, tmin);
+	}
+	OctreePacketQuery q;
+	q.mesh = this;
+	q.packet = &p;
+	q.hits = hits;
+	q.tmin = tmin;
+	for(int lane = 0; lane < PACKET_SIZE; lane++){
+		q.tmax[lane] = hits[lane].getT();
+	}
+	q.mask = mask;
+	q.result = 0;
+	q.nodesVisited = q.leavesVisited = q.trigsTested = 0;
+	octree.intersectPacket(q);
+	q.addStats();
+	return q.result;
 }
-Mesh::Mesh(const char * filename,Material * material):Object3D(material)
+int Mesh::occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax )
 {
-	std::ifstream f ;
-	f.open(filename);
-	if(!f.is_open()) {
-		std::cout<<"Cannot open "<<filename<<"\n";
-		return;
+	if(mask == 0){
+		return 0;
 	}
-	std::string line;
-	std::string vTok("v");
-	std::string fTok("f");
-	std::string texTok("vt");
-	char bslash='/',space=' ';
-	std::string tok;
-	while(1) {
-		std::getline(f,line);
-		if(f.eof()) {
-			break;
-		}
-		if(line.size()<3) {
-			continue;
-		}
-		if(line.at(0)=='#') {
-			continue;
+	if(!p.coherent(mask)){
+		return Object3D::occludedPacket(p, mask, tmin, tmax);
+	}
+	OctreePacketQuery q;
+	q.mesh = this;
+	q.packet = &p;
+	q.hits = NULL;
+	q.tmin = tmin;
+	for(int lane = 0; lane < PACKET_SIZE; lane++){
+		q.tmax[lane] = tmax[lane];
+	}
+	q.mask = mask;
+	q.result = 0;
+	q.nodesVisited = q.leavesVisited = q.trigsTested = 0;
+	octree.intersectPacket(q);
+	q.addStats();
+	return q.result;
+}
+bool Mesh::getBoundingBox( Box& box ) const
+{
+	box = octree.box;
+	return v.size()>0;
+}
+bool Mesh::intersectLeaf(const OctNode & leaf, const Ray & ray, Hit & hit, float tmin) const{
+	const Vector3f & o = ray.getOrigin();
+	const Vector3f & d = ray.getDirection();
+	float tmax = hit.getT();
+	int best = -1;
+	float bestBeta = 0, bestGamma = 0;
+	float t[4], u[4], w[4];
+	for(int pp = leaf.packStart; pp < leaf.packStart + leaf.packCount; pp++){
+		const TrigPack & pack = octree.packArray[pp];
+		int mask = pack.intersect(o, d, tmin, tmax, t, u, w);
+		for(int lane = 0; mask != 0; lane++, mask >>= 1){
+			if((mask & 1) && t[lane] < tmax){
+				tmax = t[lane];
+				best = pack.id[lane];
+				bestBeta = u[lane];
+				bestGamma = w[lane];
+			}
 		}
-		std::stringstream ss(line);
-		ss>>tok;
-		if(tok==vTok) {
-			Vector3f vec;
-			ss>>vec[0]>>vec[1]>>vec[2];
-			v.push_back(vec);
-		} else if(tok==fTok) {
-			if(line.find(bslash)!=std::string::npos) {
-				std::replace(line.begin(),line.end(),bslash,space);
-				std::stringstream facess(line);
-				Trig trig;
-				facess>>tok;
-				for(int ii=0; ii<3; ii++) {
-					facess>>trig[ii]>>trig.texID[ii];
-					trig[ii]--;
-					trig.texID[ii]--;
-				}
-				t.push_back(trig);
-			} else {
-				Trig trig;
-				for(int ii=0; ii<3; ii++) {
-					ss>>trig[ii];
-					trig[ii]--;
-					trig.texID[ii]=0;
+	}
+	if(best < 0){
+		return false;
+	}
+	hit.record(tmax, this, best, 1 - bestBeta - bestGamma, bestBeta, bestGamma);
+	return true;
+}
+
+int Mesh::intersectLeafPacket(const OctNode & leaf, const RayPacket & p, int m, Hit * hits, float tmin, float tmax[4]) const{
+	//same pack and triangle order as intersectLeaf, so ties resolve alike
+	int best[4] = {-1, -1, -1, -1};
+	float bestBeta[4], bestGamma[4];
+	float t[4], u[4], w[4];
+	for(int pp = leaf.packStart; pp < leaf.packStart + leaf.packCount; pp++){
+		const TrigPack & pack = octree.packArray[pp];
+		for(int k = 0; k < 4 && pack.id[k] >= 0; k++){
+			int mask = pack.intersectRays(k, p.o, p.d, tmin, tmax, t, u, w) & m;
+			for(int lane = 0; mask != 0; lane++, mask >>= 1){
+				if(mask & 1){
+					tmax[lane] = t[lane];
+					best[lane] = pack.id[k];
+					bestBeta[lane] = u[lane];
+					bestGamma[lane] = w[lane];
 				}
-				t.push_back(trig);
 			}
-		} else if(tok==texTok) {
-			Vector2f texcoord;
-			ss>>texcoord[0];
-			ss>>texcoord[1];
-			texCoord.push_back(texcoord);
 		}
 	}
-	f.close();
+	int result = 0;
+	for(int lane = 0; lane < PACKET_SIZE; lane++){
+		if(best[lane] >= 0){
+			hits[lane].record(tmax[lane], this, best[lane], 1 - bestBeta[lane] - bestGamma[lane], bestBeta[lane], bestGamma[lane]);
+			result |= 1 << lane;
+		}
+	}
+	return result;
+}
+
+int Mesh::occludedLeafPacket(const OctNode & leaf, const RayPacket & p, int m, float tmin, const float tmax[4]) const{
+	float t[4], u[4], w[4];
+	int blocked = 0;
+	for(int pp = leaf.packStart; pp < leaf.packStart + leaf.packCount && blocked != m; pp++){
+		const TrigPack & pack = octree.packArray[pp];
+		for(int k = 0; k < 4 && pack.id[k] >= 0; k++){
+			blocked |= pack.intersectRays(k, p.o, p.d, tmin, tmax, t, u, w) & m;
+		}
+	}
+	return blocked;
+}
+
+bool Mesh::occludedLeaf(const OctNode & leaf, const Ray & ray, float tmin, float tmax) const{
+	float t[4], u[4], w[4];
+	for(int pp = leaf.packStart; pp < leaf.packStart + leaf.packCount; pp++){
+		if(octree.packArray[pp].intersect(ray.getOrigin(), ray.getDirection(), tmin, tmax, t, u, w) != 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+void Mesh::finalizeHit(const Ray & ray, Hit & hit) const{
+	int idx = hit.getPrimitive();
+	const Trig & trig = this->t[idx];
+	float t = hit.getT();
+	float alpha = hit.getBarycentrics()[0], beta = hit.getBarycentrics()[1], gamma = hit.getBarycentrics()[2];
+
+	//small meshes use flat face normals, see SMOOTH
+	const Vector3f & na = SMOOTH ? n[trig[0]] : n[idx];
+	const Vector3f & nb = SMOOTH ? n[trig[1]] : n[idx];
+	const Vector3f & nc = SMOOTH ? n[trig[2]] : n[idx];
+	Vector3f normal = (alpha * na + beta * nb + gamma * nc).normalized();
+	hit.set(t, material, normal);
+
+	Vector2f texture;
+	if(texCoord.size()>0){
+		texture = alpha * texCoord[trig.texID[0]] + beta * texCoord[trig.texID[1]] + gamma * texCoord[trig.texID[2]];
+	}
+	hit.setTexCoord(texture);
+	if(texCoord.size()>0 && ray.hasDifferentials()){
+		Vector2f tex[3] = {texCoord[trig.texID[0]], texCoord[trig.texID[1]], texCoord[trig.texID[2]]};
+		Triangle::texDifferentials(v[trig[0]], v[trig[1]], v[trig[2]], tex, ray, t, hit);
+	}
+}
+
+Mesh::Mesh(const char * filename,Material * material, int maxTrig, int maxLevel, int numThreads):Object3D(material),
+octree(maxLevel, maxTrig)
+{
+	auto load_start = std::chrono::steady_clock::now();
+	ObjMesh obj;
+	if(!obj.load(filename)) {
+		return;
+	}
+	v.resize(obj.numVertices());
+	for(int ii=0; ii<obj.numVertices(); ii++) {
+		v[ii] = Vector3f(obj.positions[3*ii], obj.positions[3*ii+1], obj.positions[3*ii+2]);
+	}
+	t.resize(obj.numTriangles());
+	for(int ii=0; ii<obj.numTriangles(); ii++) {
+		for(int jj=0; jj<3; jj++) {
+			const ObjIndex & corner = obj.indices[3*ii+jj];
+			t[ii][jj] = corner.v;
+			t[ii].texID[jj] = std::max(corner.vt, 0);
+		}
+	}
+	texCoord.resize(obj.texCoords.size()/2);
+	for(unsigned int ii=0; ii<texCoord.size(); ii++) {
+		texCoord[ii] = Vector2f(obj.texCoords[2*ii], obj.texCoords[2*ii+1]);
+	}
 	compute_norm();
-	octree.build(*this);
+	Stats::addTime(Stats::OBJ_LOAD, std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count());
+
+	Stats::Timer build_timer(Stats::OCTREE_BUILD);
+	octree.build(*this, numThreads);
 }
 
 void Mesh::compute_norm()
@@ -15,20 +15,66 @@ struct Trig{
   int texID[3];
 };
 
+///@brief array of a mesh: owns its elements when filled by resize(), or
+///reads elements stored elsewhere (a compiled scene) after view()
+template <class T>
+class MeshArray{
+public:
+  MeshArray():items(NULL),count(0){}
+  void resize(size_t n){owned.resize(n);items=owned.empty()?NULL:&owned[0];count=n;}
+  ///@brief uses the n elements at p in place; they must outlive the
+  ///array and are only read
+  void view(const T* p, size_t n){std::vector<T>().swap(owned);items=const_cast<T*>(p);count=n;}
+  size_t size()const{return count;}
+  bool empty()const{return count==0;}
+  const T* data()const{return items;}
+  T & operator[](size_t i){return items[i];}
+  const T & operator[](size_t i)const{return items[i];}
+private:
+  MeshArray(const MeshArray&) = delete;
+  MeshArray& operator=(const MeshArray&) = delete;
+  std::vector<T> owned;
+  T* items;
+  size_t count;
+};
+
 class Mesh:public Object3D{
 public:
-  Mesh(const char * filename, Material* m);
-  std::vector<Vector3f>v;
-  std::vector<Trig>t;
-  std::vector<Vector3f>n;
-  std::vector<Vector2f>texCoord; 
+  ///@param maxTrig, maxLevel octree leaf size and depth, see Octree
+  ///@param numThreads threads building the octree, 0 for every hardware thread
+  Mesh(const char * filename, Material* m, int maxTrig = OCTREE_MAX_TRIG, int maxLevel = OCTREE_MAX_LEVEL, int numThreads = 0);
+  MeshArray<Vector3f>v;
+  MeshArray<Trig>t;
+  MeshArray<Vector3f>n;
+  MeshArray<Vector2f>texCoord;
 
   virtual bool intersect( const Ray& r , Hit& h , float tmin );
-  virtual bool intersectTrig(int idx);
+  virtual bool occluded( const Ray& r , float tmin , float tmax );
+  virtual bool getBoundingBox( Box& box ) const;
+  ///@brief packet octree traversal, lanes pointing different ways
+  ///are traced one at a time
+  virtual int intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin );
+  virtual int occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax );
+  ///@brief tests every triangle of an octree leaf, keeping the nearest hit
+  bool intersectLeaf(const OctNode & leaf, const Ray & ray, Hit & hit, float tmin) const;
+  ///@brief true if any triangle of the leaf lies in (tmin, tmax)
+  bool occludedLeaf(const OctNode & leaf, const Ray & ray, float tmin, float tmax) const;
+  ///@brief intersectLeaf for the lanes in m of a packet, each triangle
+  ///tested against four rays at once; tmax[lane] is each lane's nearest
+  ///hit so far and is lowered with it
+  ///@return lanes whose hit was moved to a triangle of the leaf
+  int intersectLeafPacket(const OctNode & leaf, const RayPacket & p, int m, Hit * hits, float tmin, float tmax[4]) const;
+  ///@brief occludedLeaf for the lanes in m of a packet
+  ///@return lanes blocked by a triangle of the leaf
+  int occludedLeafPacket(const OctNode & leaf, const RayPacket & p, int m, float tmin, const float tmax[4]) const;
+  ///@brief fills hit with the shading attributes of the triangle it
+  ///recorded and, if the ray has differentials, its texture coordinate
+  ///derivatives
+  virtual void finalizeHit(const Ray & ray, Hit & hit) const;
 private:
-  const Ray * ray;
-  Hit * hit;
-  float tm;
+  friend class SceneCache;
+  ///@brief empty mesh, filled in by SceneCache::loadMesh
+  Mesh(Material* m, int maxTrig, int maxLevel):Object3D(m),octree(maxLevel, maxTrig){}
   void compute_norm();
   Octree octree;
 };
@@ -1,29 +1,130 @@
 #include "Noise.h"
 #include "PerlinNoise.h"
 
+#include <algorithm>
+
 Vector3f Noise::getColor(const Vector3f & pos) {
 	// Fill in this function ONLY.
 	// INTERPOLATE BETWEEN TWO COLORS BY WEIGHTED AVERAGE.
 
 	// declaring variables 
-	float N, M;
+	float N;
+
+	// computing N(x,y,z), from the baked volume if it covers pos
+	if (!lookup(pos, N)) {
+		N = PerlinNoise::octaveNoise(pos, octaves);
+	}
+	return marble(pos, N);
+
+}
+
+void Noise::getColors(const Vector3f * pos, int count, Vector3f * colors) {
+	/*
+	Description:
+		Batched getColor, gives the same colours point by point.
+	Arguments:
+		- pos: count points.
+		- colors: receives count colours.
+	*/
+
+	// declaring variables
+	std::vector<float> N(count);
+
+	if (count <= 0) { return; }
+	if (volume.empty()) {
+		PerlinNoise::octaveNoise(pos, count, octaves, &N[0]);
+	}
+	else {
+		for (int k = 0; k < count; k++) {
+			if (!lookup(pos[k], N[k])) { N[k] = PerlinNoise::octaveNoise(pos[k], octaves); }
+		}
+	}
+	for (int k = 0; k < count; k++) {
+		colors[k] = marble(pos[k], N[k]);
+	}
+}
+
+Vector3f Noise::marble(const Vector3f & pos, float N) const {
+
+	// declaring variables
+	float M;
 
-	// computing N(x,y,z) and M(x,y,z)
-	N = PerlinNoise::octaveNoise(pos, octaves);
+	// computing M(x,y,z)
 	M = sin(frequency * pos.x() + amplitude * N); // for marbled material 
 	M = (M + 1.) / 2.; // clamping
 
 	return (M * color[0] + (1. - M) * color[1]); // interpolate two colors
+}
+
+void Noise::bake(const Box & box) {
+	/*
+	Description:
+		Samples the octave noise at the (bakeResolution + 1)^3 grid points
+		spanning box, one row of points per batch.
+	Arguments:
+		- box: world space region to cover, normally the bounds of the
+		  objects using this noise.
+	*/
+
+	// declaring variables
+	int samples = bakeResolution + 1;
+	Vector3f extent;
+	std::vector<Vector3f> row(samples);
+
+	if (bakeResolution <= 0) { return; }
+	volumeMin = box.mn;
+	for (int dim = 0; dim < 3; dim++) {
+		extent[dim] = std::max(box.mx[dim] - box.mn[dim], 1e-4f); // flat boxes still get one cell
+		volumeScale[dim] = bakeResolution / extent[dim];
+	}
+	volume.resize((size_t)samples * samples * samples);
+	for (int z = 0; z < samples; z++) {
+		for (int y = 0; y < samples; y++) {
+			for (int x = 0; x < samples; x++) {
+				row[x] = volumeMin + Vector3f(x * extent[0], y * extent[1], z * extent[2]) / (float)bakeResolution;
+			}
+			PerlinNoise::octaveNoise(&row[0], samples, octaves, &volume[((size_t)z * samples + y) * samples]);
+		}
+	}
+}
+
+bool Noise::lookup(const Vector3f & pos, float & N) const {
+
+	if (volume.empty()) { return false; }
+
+	// declaring variables
+	int samples = bakeResolution + 1;
+	int cell[3];
+	float frac[3];
+
+	for (int dim = 0; dim < 3; dim++) {
+		float g = (pos[dim] - volumeMin[dim]) * volumeScale[dim];
+		if (!(g >= 0.f && g <= bakeResolution)) { return false; } // also rejects NaN
+		cell[dim] = std::min((int)g, bakeResolution - 1);
+		frac[dim] = g - cell[dim];
+	}
 
+	// trilinear interpolation of the 8 samples around pos
+	const float* s = &volume[((size_t)cell[2] * samples + cell[1]) * samples + cell[0]];
+	size_t dy = samples, dz = (size_t)samples * samples;
+	float c00 = s[0] + frac[0] * (s[1] - s[0]);
+	float c10 = s[dy] + frac[0] * (s[dy + 1] - s[dy]);
+	float c01 = s[dz] + frac[0] * (s[dz + 1] - s[dz]);
+	float c11 = s[dz + dy] + frac[0] * (s[dz + dy + 1] - s[dz + dy]);
+	float c0 = c00 + frac[1] * (c10 - c00);
+	float c1 = c01 + frac[1] * (c11 - c01);
+	N = c0 + frac[2] * (c1 - c0);
+	return true;
 }
 
-Noise::Noise(int _octaves,const Vector3f & color1, const Vector3f &color2,float freq,float amp): octaves(_octaves),frequency(freq),amplitude(amp) {
+Noise::Noise(int _octaves,const Vector3f & color1, const Vector3f &color2,float freq,float amp): octaves(_octaves),frequency(freq),amplitude(amp),bakeResolution(0) {
 	color[0] = color1;
 	color[1] = color2;
 	init = true;
 }
 
-Noise::Noise(const Noise & n): octaves(n.octaves),frequency(n.frequency), amplitude(n.amplitude),init(n.init) {
+Noise::Noise(const Noise & n): octaves(n.octaves),frequency(n.frequency), amplitude(n.amplitude),init(n.init),bakeResolution(n.bakeResolution),
+	volume(n.volume),volumeMin(n.volumeMin),volumeScale(n.volumeScale) {
 	color[0] = n.color[0];
 	color[1] = n.color[1];
 }
@@ -32,4 +133,4 @@ bool Noise::valid() {
 	return init;
 }
 
-Noise::Noise(): octaves(0),init(false) {}
+Noise::Noise(): octaves(0),init(false),bakeResolution(0) {}
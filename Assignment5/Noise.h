@@ -1,14 +1,24 @@
 #ifndef NOISE_H
 #define NOISE_H
+#include <vector>
 #include "vecmath.h"
+#include "Box.h"
 class Noise
 {
 public:
 	Noise();
 	Noise(int _octaves , const Vector3f & color1 = Vector3f::ZERO, const Vector3f & color2 = Vector3f(1.f,1.f,1.f), float freq=1, float amp=1);
 	Vector3f getColor(const Vector3f & pos);
+	///@brief getColor at count points, the octave noise of which is
+	///evaluated four points at a time
+	void getColors(const Vector3f * pos, int count, Vector3f * colors);
 	bool valid();
 
+	///@brief samples the octave noise on a grid of bakeResolution cells
+	///per axis over box; points inside it then interpolate the grid
+	///trilinearly instead of evaluating every octave
+	void bake(const Box & box);
+
 	Noise(const Noise & n);
 
 	Vector3f color[2];
@@ -16,6 +26,21 @@ public:
 	float frequency;
 	float amplitude;
 	bool init;
+	///@brief cells per axis of the baked volume, 0 to always evaluate the noise
+	int bakeResolution;
+
+private:
+
+	///@brief octave noise at pos from the baked volume
+	///@return false if nothing is baked or pos lies outside the volume
+	bool lookup(const Vector3f & pos, float & N) const;
+	///@brief marble colour at pos for the octave noise N
+	Vector3f marble(const Vector3f & pos, float N) const;
+
+	// (bakeResolution + 1)^3 samples, x fastest
+	std::vector<float> volume;
+	Vector3f volumeMin;
+	Vector3f volumeScale; // cells per unit length
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,8 @@
 #include "Ray.h"
 #include "Hit.h"
 #include "Material.h"
+#include "Box.h"
+#include "RayPacket.h"
 #include<iostream>
 
 using namespace std;
@@ -14,7 +16,38 @@ public:
 	Object3D() { material = NULL; }
 	virtual ~Object3D() {}
 	Object3D(Material* material) { this->material = material; }
+	Material* getMaterial() const { return material; }
 	virtual bool intersect(const Ray& r, Hit& h, float tmin) = 0;
+	///@brief any-hit query for shadow rays: true as soon as anything
+	///lies in (tmin, tmax) along r, without searching for the nearest
+	///hit or filling in a Hit
+	virtual bool occluded(const Ray& r, float tmin, float tmax) = 0;
+	///@brief fills in the material, normal and texture coordinates of
+	///a hit this object recorded, in object space
+	///@param r the ray that found it, in object space
+	virtual void finalizeHit(const Ray& /*r*/, Hit& /*h*/) const {}
+	///@brief world space bounds of the object
+	///@return false if the object is unbounded (e.g. a plane)
+	virtual bool getBoundingBox(Box& /*box*/) const { return false; }
+	///@brief intersect for the lanes of p in mask, hits[lane] belongs to
+	///p.ray[lane]. The default traces the lanes one at a time.
+	///@return mask of the lanes whose hit was updated
+	virtual int intersectPacket(const RayPacket& p, int mask, Hit* hits, float tmin) {
+		int result = 0;
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if ((mask & (1 << lane)) && intersect(*p.ray[lane], hits[lane], tmin)) { result |= 1 << lane; }
+		}
+		return result;
+	}
+	///@brief occluded for the lanes of p in mask, each with its own tmax
+	///@return mask of the occluded lanes
+	virtual int occludedPacket(const RayPacket& p, int mask, float tmin, const float* tmax) {
+		int result = 0;
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if ((mask & (1 << lane)) && occluded(*p.ray[lane], tmin, tmax[lane])) { result |= 1 << lane; }
+		}
+		return result;
+	}
 	char* type;
 
 protected:
@@ -4,6 +4,13 @@
 
 #include "PerlinNoise.h"
 
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PERLIN_NOISE_SSE
+#endif
+
 // permutation
 int PerlinNoise::p[512] = 
     { 151,160,137, 91, 90, 15,131, 13,201, 95, 96, 53,194,233,  7,225,
@@ -40,3 +47,137 @@ int PerlinNoise::p[512] =
        81, 51,145,235,249, 14,239,107, 49,192,214, 31,181,199,106,157,
       184, 84,204,176,115,121, 50, 45,127,  4,150,254,138,236,205, 93,
       222,114, 67, 29, 24, 72,243,141,128,195, 78, 66,215, 61,156,180};
+
+// 2^i and 1/2^i per octave, both exact, so scaling by the weight gives
+// the same value as dividing by the frequency
+static constexpr float octave_frequency[PERLIN_MAX_OCTAVES] = {
+    1.f, 2.f, 4.f, 8.f, 16.f, 32.f, 64.f, 128.f,
+    256.f, 512.f, 1024.f, 2048.f, 4096.f, 8192.f, 16384.f, 32768.f };
+static constexpr float octave_weight[PERLIN_MAX_OCTAVES] = {
+    1.f, 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f, 0.015625f, 0.0078125f,
+    0.00390625f, 0.001953125f, 0.0009765625f, 0.00048828125f,
+    0.000244140625f, 0.0001220703125f, 0.00006103515625f, 0.000030517578125f };
+
+// the 12 gradient directions of grad() (4 repeated), so that
+// grad(h, x, y, z) = g[0] * x + g[1] * y + g[2] * z
+static const float gradients[16][3] = {
+    { 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+    { 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+    { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+    { 1, 1, 0 }, { 0, -1, 1 }, { -1, 1, 0 }, { 0, -1, -1 } };
+
+void PerlinNoise::noise4( const float x[4], const float y[4], const float z[4], float out[4] )
+{
+    alignas(16) float frac[3][4];     // position inside the unit cube
+    alignas(16) float grad[8][3][4];  // gradient at each corner, corner bits are x, y, z
+
+    // unit cube and corner hashes, one lane at a time
+    for (int lane = 0; lane < 4; lane++)
+    {
+        const float pt[3] = { x[lane], y[lane], z[lane] };
+        int cell[3];
+        for (int dim = 0; dim < 3; dim++)
+        {
+            float f = floorf(pt[dim]);
+            cell[dim] = (int)f & 255;
+            frac[dim][lane] = pt[dim] - f;
+        }
+        int A = p[cell[0]  ]+cell[1]; int AA = p[A]+cell[2]; int AB = p[A+1]+cell[2];
+        int B = p[cell[0]+1]+cell[1]; int BA = p[B]+cell[2]; int BB = p[B+1]+cell[2];
+        const int hash[8] = { p[AA], p[BA], p[AB], p[BB], p[AA+1], p[BA+1], p[AB+1], p[BB+1] };
+        for (int corner = 0; corner < 8; corner++)
+            for (int dim = 0; dim < 3; dim++)
+                grad[corner][dim][lane] = gradients[hash[corner] & 15][dim];
+    }
+
+#ifdef PERLIN_NOISE_SSE
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 t[3], fade[3], dist[8];
+    for (int dim = 0; dim < 3; dim++)
+    {
+        t[dim] = _mm_load_ps(frac[dim]);
+        // t * t * t * (t * (t * 6 - 15) + 10)
+        __m128 poly = _mm_add_ps(_mm_mul_ps(t[dim], _mm_sub_ps(_mm_mul_ps(t[dim], _mm_set1_ps(6.f)), _mm_set1_ps(15.f))), _mm_set1_ps(10.f));
+        fade[dim] = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t[dim], t[dim]), t[dim]), poly);
+    }
+    for (int corner = 0; corner < 8; corner++)
+    {
+        __m128 dx = (corner & 1) ? _mm_sub_ps(t[0], one) : t[0];
+        __m128 dy = (corner & 2) ? _mm_sub_ps(t[1], one) : t[1];
+        __m128 dz = (corner & 4) ? _mm_sub_ps(t[2], one) : t[2];
+        dist[corner] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(grad[corner][0]), dx), _mm_mul_ps(_mm_load_ps(grad[corner][1]), dy)),
+            _mm_mul_ps(_mm_load_ps(grad[corner][2]), dz));
+    }
+    // blend along x, then y, then z: a + t * (b - a)
+    for (int dim = 0, step = 1; dim < 3; dim++, step *= 2)
+        for (int corner = 0; corner < 8; corner += 2 * step)
+            dist[corner] = _mm_add_ps(dist[corner], _mm_mul_ps(fade[dim], _mm_sub_ps(dist[corner + step], dist[corner])));
+    _mm_storeu_ps(out, dist[0]);
+#else
+    for (int lane = 0; lane < 4; lane++)
+    {
+        float t[3], fade[3], dist[8];
+        for (int dim = 0; dim < 3; dim++)
+        {
+            t[dim] = frac[dim][lane];
+            fade[dim] = t[dim] * t[dim] * t[dim] * (t[dim] * (t[dim] * 6.f - 15.f) + 10.f);
+        }
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float dx = (corner & 1) ? t[0] - 1.f : t[0];
+            float dy = (corner & 2) ? t[1] - 1.f : t[1];
+            float dz = (corner & 4) ? t[2] - 1.f : t[2];
+            dist[corner] = grad[corner][0][lane] * dx + grad[corner][1][lane] * dy + grad[corner][2][lane] * dz;
+        }
+        for (int dim = 0, step = 1; dim < 3; dim++, step *= 2)
+            for (int corner = 0; corner < 8; corner += 2 * step)
+                dist[corner] = dist[corner] + fade[dim] * (dist[corner + step] - dist[corner]);
+        out[lane] = dist[0];
+    }
+#endif
+}
+
+float PerlinNoise::octaveNoise( const Vector3f& pt, int octaves )
+{
+    float x[4], y[4], z[4], n[4];
+    float answer = 0.f;
+    octaves = std::min(octaves, PERLIN_MAX_OCTAVES);
+    for (int first = 0; first < octaves; first += 4)
+    {
+        // one octave per lane, lanes past the last octave are ignored
+        for (int lane = 0; lane < 4; lane++)
+        {
+            float freq = octave_frequency[std::min(first + lane, octaves - 1)];
+            x[lane] = freq * pt[0]; y[lane] = freq * pt[1]; z[lane] = freq * pt[2];
+        }
+        noise4(x, y, z, n);
+        for (int lane = 0; lane < 4 && first + lane < octaves; lane++)
+            answer += n[lane] * octave_weight[first + lane];
+    }
+    return answer;
+}
+
+void PerlinNoise::octaveNoise( const Vector3f* pts, int count, int octaves, float* out )
+{
+    float x[4], y[4], z[4], n[4];
+    octaves = std::min(octaves, PERLIN_MAX_OCTAVES);
+    for (int first = 0; first < count; first += 4)
+    {
+        // one point per lane, the last point fills the unused lanes
+        int lanes = std::min(4, count - first);
+        float answer[4] = { 0.f, 0.f, 0.f, 0.f };
+        for (int i = 0; i < octaves; i++)
+        {
+            for (int lane = 0; lane < 4; lane++)
+            {
+                const Vector3f& pt = pts[first + std::min(lane, lanes - 1)];
+                x[lane] = octave_frequency[i] * pt[0]; y[lane] = octave_frequency[i] * pt[1]; z[lane] = octave_frequency[i] * pt[2];
+            }
+            noise4(x, y, z, n);
+            for (int lane = 0; lane < lanes; lane++)
+                answer[lane] += n[lane] * octave_weight[i];
+        }
+        for (int lane = 0; lane < lanes; lane++)
+            out[first + lane] = answer[lane];
+    }
+}
@@ -9,6 +9,11 @@
 #include <cstdio>
 #include <Vector3f.h>
 
+// octaves past this are dropped: together they add less than 2^-15 of
+// the first, which 8 bit colours do not show unless the amplitude is
+// in the hundreds
+#define PERLIN_MAX_OCTAVES 16
+
 class PerlinNoise
 {
 public:
@@ -37,16 +42,18 @@ public:
     }
 
 
-    static double octaveNoise( const Vector3f& pt, int octaves )
-    {
-        double answer = 0;
-        for (int i = 0; i < octaves; i++)
-        {
-            float tmp = pow(2.0f,i);
-            answer += noise(tmp*pt[0], tmp*pt[1], tmp*pt[2]) / float(tmp);
-        }
-        return answer;
-    }
+    ///@brief improved noise at four points at once, in float. The hash
+    ///lookups are scalar, the fade curves, gradients and blending run
+    ///on all four lanes together.
+    static void noise4( const float x[4], const float y[4], const float z[4], float out[4] );
+
+    ///@brief sum of noise(2^i pt) / 2^i over the first octaves (at most
+    ///PERLIN_MAX_OCTAVES), evaluating four octaves per noise4 call
+    static float octaveNoise( const Vector3f& pt, int octaves );
+
+    ///@brief octaveNoise at count points, four points per noise4 call;
+    ///gives exactly the values of the single point version
+    static void octaveNoise( const Vector3f* pts, int count, int octaves, float* out );
 
 private:
 
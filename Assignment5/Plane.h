@@ -36,7 +36,7 @@ public:
 
 		t = - (N_r_o - this->_d) / (N_r_d); // computing ray parameter
 		if (t > tmin && t < h.getT()) {
-			h.set(t, this->material, this->_normal);
+			h.record(t, this, 0, 0.f, 0.f, 0.f);
 			return true;
 		}
 		else {
@@ -44,8 +44,76 @@ public:
 		}
 	}
 
+	virtual void finalizeHit( const Ray& /*r*/ , Hit& h ) const {
+		h.set(h.getT(), this->material, this->_normal);
+	}
+
+	virtual bool occluded( const Ray& r , float tmin , float tmax ){
+
+		// declaring variables
+		float N_r_d, N_r_o, t;
+
+		N_r_d = Vector3f::dot(this->_normal, r.getDirection().normalized()); // dot product between N and r_d
+		N_r_o = Vector3f::dot(this->_normal, r.getOrigin()); // dot product between N and  r_o
+
+		if (N_r_d == 0.) { return false; } // grazing rays
+
+		t = - (N_r_o - this->_d) / (N_r_d); // computing ray parameter
+		return t > tmin && t < tmax;
+	}
+
+#ifdef RAY_PACKET_SSE
+	virtual int intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin ){
+
+		// declaring variables
+		float t[PACKET_SIZE];
+		int result = 0;
+
+		mask &= distances(p, t);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if ((mask & (1 << lane)) && t[lane] > tmin && t[lane] < hits[lane].getT()) {
+				hits[lane].record(t[lane], this, 0, 0.f, 0.f, 0.f);
+				result |= 1 << lane;
+			}
+		}
+		return result;
+	}
+
+	virtual int occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax ){
+
+		// declaring variables
+		float t[PACKET_SIZE];
+		int result = 0;
+
+		mask &= distances(p, t);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if ((mask & (1 << lane)) && t[lane] > tmin && t[lane] < tmax[lane]) {
+				result |= 1 << lane;
+			}
+		}
+		return result;
+	}
+#endif
+
 protected:
 
+#ifdef RAY_PACKET_SSE
+	///@brief ray parameter of the plane for four rays, computed like intersect
+	///@return mask of the lanes that are not parallel to the plane
+	int distances( const RayPacket& p , float t[4] ) const {
+		__m128 dx = _mm_load_ps(p.d[0]), dy = _mm_load_ps(p.d[1]), dz = _mm_load_ps(p.d[2]);
+		__m128 norm = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 nx = _mm_set1_ps(_normal[0]), ny = _mm_set1_ps(_normal[1]), nz = _mm_set1_ps(_normal[2]);
+		__m128 N_r_d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_div_ps(dx, norm)), _mm_mul_ps(ny, _mm_div_ps(dy, norm))),
+			_mm_mul_ps(nz, _mm_div_ps(dz, norm)));
+		__m128 N_r_o = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_load_ps(p.o[0])), _mm_mul_ps(ny, _mm_load_ps(p.o[1]))),
+			_mm_mul_ps(nz, _mm_load_ps(p.o[2])));
+		__m128 num = _mm_xor_ps(_mm_sub_ps(N_r_o, _mm_set1_ps(_d)), _mm_set1_ps(-0.f));
+		_mm_storeu_ps(t, _mm_div_ps(num, N_r_d));
+		return _mm_movemask_ps(_mm_cmpneq_ps(N_r_d, _mm_setzero_ps()));
+	}
+#endif
+
 	Vector3f _normal;
 	float _d;
 
@@ -0,0 +1,44 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+///@brief small deterministic random number generator.
+///Seeded from the pixel coordinate so that jittered renders are
+///bit-identical no matter how many threads draw the image or
+///in which order the pixels are visited.
+class PixelRandom
+{
+public:
+
+    PixelRandom( unsigned int i, unsigned int j, unsigned int seed = 0 )
+    {
+        state = mix( ( (unsigned long long)i << 32 ) ^ j ^ ( (unsigned long long)seed << 48 ) );
+    }
+
+    ///@brief next raw 32 bit value
+    unsigned int next()
+    {
+        state += 0x9E3779B97F4A7C15ULL;
+        return (unsigned int)( mix( state ) >> 32 );
+    }
+
+    ///@brief uniform float in [0,1)
+    float uniform()
+    {
+        return ( next() >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+private:
+
+    // splitmix64 finalizer
+    static unsigned long long mix( unsigned long long z )
+    {
+        z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+        z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+        return z ^ ( z >> 31 );
+    }
+
+    unsigned long long state;
+
+};
+
+#endif // RANDOM_H
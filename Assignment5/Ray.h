@@ -7,6 +7,15 @@
 
 using namespace std;
 
+///@brief ray differentials (Igehy 1999): how the origin and direction
+///of a ray change from one pixel to the next in x and y. They size the
+///footprint of texture lookups.
+struct RayDifferentials
+{
+    Vector3f dOdx, dOdy;
+    Vector3f dDdx, dDdy;
+};
+
 // Ray class mostly copied from Peter Shirley and Keith Morley
 class Ray
 {
@@ -16,12 +25,24 @@ public:
     {
         origin = orig; 
         direction = dir;
+        hasDiff = false;
     }
 
     Ray( const Ray& r )
     { 
         origin = r.origin;
         direction = r.direction;
+        hasDiff = r.hasDiff;
+        if (hasDiff) { diff = r.diff; }
+    }
+
+    Ray& operator=( const Ray& r )
+    {
+        origin = r.origin;
+        direction = r.direction;
+        hasDiff = r.hasDiff;
+        if (hasDiff) { diff = r.diff; }
+        return *this;
     }
 
     const Vector3f& getOrigin() const
@@ -39,6 +60,37 @@ public:
         return origin + direction * t;
     }
 
+    bool hasDifferentials() const
+    {
+        return hasDiff;
+    }
+
+    const RayDifferentials& getDifferentials() const
+    {
+        return diff;
+    }
+
+    void setDifferentials( const RayDifferentials& d )
+    {
+        diff = d;
+        hasDiff = true;
+    }
+
+    ///@brief how the hit point at t on a surface with normal n moves
+    ///per pixel step, see Igehy 1999
+    ///@return false if the ray has no differentials or grazes the surface
+    bool transferDifferentials( float t, const Vector3f& n, Vector3f& dPdx, Vector3f& dPdy ) const
+    {
+        float dn = Vector3f::dot(direction, n);
+        if (!hasDiff || dn == 0.f) { return false; }
+        dPdx = diff.dOdx + t * diff.dDdx;
+        dPdy = diff.dOdy + t * diff.dDdy;
+        // slide along the ray back onto the tangent plane
+        dPdx = dPdx - (Vector3f::dot(dPdx, n) / dn) * direction;
+        dPdy = dPdy - (Vector3f::dot(dPdy, n) / dn) * direction;
+        return true;
+    }
+
 private:
 
     // don't use this constructor
@@ -49,6 +101,8 @@ private:
 
     Vector3f origin;
     Vector3f direction;
+    bool hasDiff;
+    RayDifferentials diff; // only valid if hasDiff
 
 };
 
@@ -0,0 +1,105 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include <algorithm>
+#include "Ray.h"
+#include "Box.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAY_PACKET_SSE
+#endif
+
+#define PACKET_SIZE 4
+
+///@brief up to four coherent rays (neighbouring camera rays, or shadow
+///rays towards one light) in structure-of-arrays layout, traced together
+///through the BVH and the mesh octrees. Lanes are selected with a bit
+///mask; unused lanes still point at a valid ray.
+struct alignas(16) RayPacket
+{
+	float o[3][4];
+	float d[3][4];
+	///@brief 1/d, for the slab tests
+	float inv[3][4];
+	const Ray * ray[4];
+	///@brief lanes holding a ray
+	int mask;
+
+	///@param count number of rays, 1 to PACKET_SIZE
+	RayPacket(const Ray * const * rays, int count){
+		mask = (1 << count) - 1;
+		for(int lane = 0; lane < PACKET_SIZE; lane++){
+			ray[lane] = rays[lane < count ? lane : 0];
+			for(int dim = 0; dim < 3; dim++){
+				o[dim][lane] = ray[lane]->getOrigin()[dim];
+				d[dim][lane] = ray[lane]->getDirection()[dim];
+				inv[dim][lane] = 1.f / d[dim][lane];
+			}
+		}
+	}
+
+	///@brief true if the directions of the lanes in m share their signs,
+	///so one near-to-far child order suits all of them
+	bool coherent(int m) const{
+		int signs = -1;
+		for(int lane = 0; lane < PACKET_SIZE; lane++){
+			if(!(m & (1 << lane))){
+				continue;
+			}
+			int s = (d[0][lane] < 0) << 2 | (d[1][lane] < 0) << 1 | (d[2][lane] < 0);
+			if(signs >= 0 && s != signs){
+				return false;
+			}
+			signs = s;
+		}
+		return true;
+	}
+
+	///@brief number of lanes set in m
+	static int laneCount(int m){
+		return (m & 1) + (m >> 1 & 1) + (m >> 2 & 1) + (m >> 3 & 1);
+	}
+
+	///@brief slab test of every lane against box within [tmin, tmax[lane]],
+	///same rounding pad as the single ray test in BVH.cpp
+	///@return mask of the lanes that hit, tnear receives their entry t
+	int hitBox(const Box & box, float tmin, const float tmax[4], float tnear[4]) const;
+};
+
+inline int RayPacket::hitBox(const Box & box, float tmin, const float tmax[4], float tnear[4]) const
+{
+#ifdef RAY_PACKET_SSE
+	__m128 tn = _mm_set1_ps(tmin);
+	__m128 tf = _mm_loadu_ps(tmax);
+	for(int dim = 0; dim < 3; dim++){
+		__m128 io = _mm_load_ps(inv[dim]);
+		__m128 oo = _mm_load_ps(o[dim]);
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.mn[dim]), oo), io);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.mx[dim]), oo), io);
+		// operand order makes NaNs (ray in the slab plane) drop out
+		tn = _mm_max_ps(_mm_min_ps(t1, t0), tn);
+		tf = _mm_min_ps(_mm_max_ps(t1, t0), tf);
+	}
+	_mm_storeu_ps(tnear, tn);
+	return _mm_movemask_ps(_mm_cmple_ps(tn, _mm_mul_ps(tf, _mm_set1_ps(1.0000008f))));
+#else
+	int hits = 0;
+	for(int lane = 0; lane < PACKET_SIZE; lane++){
+		float tn = tmin, tf = tmax[lane];
+		for(int dim = 0; dim < 3; dim++){
+			float t0 = (box.mn[dim] - o[dim][lane]) * inv[dim][lane];
+			float t1 = (box.mx[dim] - o[dim][lane]) * inv[dim][lane];
+			tn = std::max(tn, std::min(t0, t1));
+			tf = std::min(tf, std::max(t0, t1));
+		}
+		tnear[lane] = tn;
+		if(tn <= tf * 1.0000008f){
+			hits |= 1 << lane;
+		}
+	}
+	return hits;
+#endif
+}
+
+#endif // RAY_PACKET_H
@@ -5,8 +5,16 @@
 #include "Group.h"
 #include "Material.h"
 #include "Light.h"
+#include "Random.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 
 #define EPSILON 0.01
+// lights whose packet shadow results fit on the stack, more use the heap
+#define PACKET_STACK_LIGHTS 64
 
 //IMPLEMENT THESE FUNCTIONS
 Vector3f mirrorDirection( const Vector3f& normal, const Vector3f& incoming) {
@@ -61,16 +69,189 @@ bool transmittedDirection( const Vector3f& normal, const Vector3f& incoming, flo
 	
 }
 
+Vector3f mirrorDirection( const Vector3f& normal, const Vector3f& incoming, const Vector3f dIncoming[2], Vector3f dReflected[2] ) {
+	/*
+	Description:
+		mirrorDirection that also carries the ray differentials of the
+		direction (Igehy 1999), taking the normal as constant across the
+		pixel like on a flat surface.
+	Arguments:
+		- dIncoming: change of the incoming direction per pixel in x and y.
+		- dReflected: receives the change of the reflected direction.
+	*/
+
+	for (int k = 0; k < 2; k++) {
+		dReflected[k] = dIncoming[k] - 2 * Vector3f::dot(dIncoming[k], normal) * normal;
+	}
+	return mirrorDirection(normal, incoming);
+}
+
+bool transmittedDirection( const Vector3f& normal, const Vector3f& incoming, float index_n, float index_nt, Vector3f& transmitted,
+	const Vector3f dIncoming[2], Vector3f dTransmitted[2] ) {
+	/*
+	Description:
+		transmittedDirection that also carries the ray differentials of the
+		direction, see mirrorDirection.
+	Return:
+		false on total internal reflection.
+	*/
+
+	if (!transmittedDirection(normal, incoming, index_n, index_nt, transmitted)) { return false; }
+
+	// declaring variables
+	float refrac_ratio, n_I, cos_t, dmu;
+
+	// transmitted = refrac_ratio * incoming - mu * normal, mu depending on n_I
+	refrac_ratio = index_n / index_nt;
+	n_I = Vector3f::dot(normal, incoming);
+	cos_t = sqrt(max(0.f, 1.f - refrac_ratio * refrac_ratio * (1.f - n_I * n_I)));
+	dmu = cos_t > 0.f ? refrac_ratio + refrac_ratio * refrac_ratio * n_I / cos_t : 0.f;
+	for (int k = 0; k < 2; k++) {
+		dTransmitted[k] = refrac_ratio * dIncoming[k] - dmu * Vector3f::dot(normal, dIncoming[k]) * normal;
+	}
+	return true;
+}
+
+static void bounceDifferentials( const Ray& ray, const Hit& hit, float refr_index, const Vector3f& normal, float refr_index_new,
+	Ray* reflected, Ray* refracted ) {
+	/*
+	Description:
+		Carries the differentials of ray across its hit into the reflected
+		and refracted rays, so that texture lookups further down the ray
+		tree still know their footprint.
+	Arguments:
+		- refr_index, normal, refr_index_new: as used for the refracted direction.
+		- reflected, refracted: rays leaving the hit, either may be NULL.
+	*/
+
+	// declare variables
+	Vector3f dP[2], dD[2], dOut[2], dir;
+	RayDifferentials d;
+
+	if (!ray.transferDifferentials(hit.getT(), hit.getNormal().normalized(), dP[0], dP[1])) { return; }
+	dD[0] = ray.getDifferentials().dDdx;
+	dD[1] = ray.getDifferentials().dDdy;
+	d.dOdx = dP[0];
+	d.dOdy = dP[1];
+
+	if (reflected != NULL) {
+		mirrorDirection(hit.getNormal().normalized(), ray.getDirection(), dD, dOut);
+		d.dDdx = dOut[0]; d.dDdy = dOut[1];
+		reflected->setDifferentials(d);
+	}
+	if (refracted != NULL && transmittedDirection(normal, ray.getDirection(), refr_index, refr_index_new, dir, dD, dOut)) {
+		d.dDdx = dOut[0]; d.dDdy = dOut[1];
+		refracted->setDifferentials(d);
+	}
+}
+
 //more arguments if you need...
-RayTracer::RayTracer( SceneParser* scene, int max_bounces, bool shadow_tog) : m_scene(scene) {
+RayTracer::RayTracer( SceneParser* scene, int max_bounces, bool shadow_tog, float prune_threshold, int light_samples) : m_scene(scene) {
   g = scene->getGroup();
   m_maxBounces = max_bounces;
   shadow_toggle = shadow_tog;
+  m_pruneThreshold = prune_threshold;
+  m_lightSamples = light_samples;
+  m_selectLights = light_samples > 0 || scene->getLightTree().culls();
 }
 
 RayTracer::~RayTracer() {}
 
-Vector3f RayTracer::traceRay( Ray& ray, float tmin, int bounces, float refr_index, Hit& hit ) const {
+void RayTracer::selectLights( const Vector3f& p, std::vector<LightSample>& selected ) const {
+	/*
+	Description:
+		Finds the lights that reach p, or samples m_lightSamples of them.
+		The picks are seeded from the point itself, so every engine and
+		thread count picks the same lights.
+	*/
+
+	if (m_lightSamples <= 0) {
+		m_scene->getLightTree().gather(p, selected);
+		return;
+	}
+	unsigned int bits[3];
+	memcpy(bits, &p[0], sizeof(bits));
+	PixelRandom random(bits[0], bits[1] ^ (bits[2] * 0x9E3779B9u));
+	m_scene->getLightTree().sample(p, m_lightSamples, random, selected);
+}
+
+static void recordHit( AOVSample* aov, const Ray& ray, const Hit& hit ) {
+	/*
+	Description:
+		Fills the output variables; no hit counted yet means this is the primary ray.
+		The normal and the albedo are only computed if the sample asks for them.
+	*/
+
+	if (aov == NULL) { return; }
+	if (aov->hitCount == 0) {
+		aov->hit = true;
+		aov->depth = hit.getT();
+		if (aov->fields & AOVSample::NORMAL) { aov->normal = hit.getNormal().normalized(); }
+		if (aov->fields & AOVSample::ALBEDO) { aov->albedo = hit.getMaterial()->getAlbedo(ray, hit); }
+		aov->objectId = hit.objectId;
+	}
+	aov->hitCount++;
+}
+
+void RayTracer::getBranches( const Ray& ray, const Hit& hit, float refr_index, float weight, Branches& b ) const {
+	/*
+	Description:
+		Computes the refraction direction, the Schlick reflectance and the
+		weight of the reflected and refracted rays at a hit.
+	Arguments:
+		- ray: incoming ray.
+		- hit: its hit.
+		- refr_index: refractive index of the medium the ray travels in.
+		- weight: weight of the incoming ray.
+		- b: receives the result.
+	*/
+
+	// init ray items
+	b.spec_col = hit.getMaterial()->getSpecularColor();
+	float spec_max = max(b.spec_col[0], max(b.spec_col[1], b.spec_col[2]));
+	b.refr_index_new = hit.getMaterial()->getRefractionIndex();
+	Vector3f normal = (hit.getNormal()).normalized();
+	if (Vector3f::dot(ray.getDirection(), normal) > 0.) { // checking if normal needs to be negated
+		b.refr_index_new = 1.f; // new refractive index
+		normal = -normal; // negating normal
+	}
+	b.refract_dir = Vector3f(0., 0., 0.); // init refraction direction (updated below)
+	b.normal = normal;
+
+	// init boolean variable to check for refraction
+	b.refract_on = transmittedDirection(normal, ray.getDirection(), refr_index, b.refr_index_new, b.refract_dir);
+
+	// Schlick's approximation, all reflection without refraction
+	b.R = 1.f;
+	if (b.refract_on) {
+		float c, R_0;
+		if (refr_index <= b.refr_index_new) { c = abs(Vector3f::dot(ray.getDirection(), normal)); } 
+		else { c = abs(Vector3f::dot(b.refract_dir, normal)); }
+		R_0 = pow(((b.refr_index_new - refr_index) / (b.refr_index_new + refr_index)), 2); 
+		b.R = R_0 + (1. - R_0) * pow(1. - c, 5); 
+	}
+
+	// a branch is only traced if it can still change the pixel
+	b.weight_refl = weight * spec_max * b.R;
+	b.weight_refr = weight * spec_max * (1.f - b.R);
+}
+
+static void addBranches( Vector3f& pix_col, const Vector3f& spec_col, float R, bool refract_on,
+	const Vector3f& reflect_col, const Vector3f& refractColor ) {
+	/*
+	Description:
+		Adds the specular part of the reflected and refracted colours.
+	*/
+
+	if (refract_on) {
+		pix_col += (1. - R) * spec_col * refractColor + R* reflect_col * spec_col;
+	}
+	else {
+		pix_col += reflect_col * spec_col; // only reflection
+	}
+}
+
+Vector3f RayTracer::traceRay( Ray& ray, float tmin, int bounces, float refr_index, Hit& hit, AOVSample* aov, float weight ) const {
 	/*
 	Description:
 		Performs ray tracing based on specified number of ray bounces.
@@ -80,101 +261,447 @@ Vector3f RayTracer::traceRay( Ray& ray, float tmin, int bounces, float refr_inde
 		- bounces: number of ray tracing bounces.
 		- refr_index: refractive index of material.
 		- hit: Hit class instance.
+		- aov: optional per-pixel outputs, filled on the primary (first) hit.
+		- weight: largest channel of the ray's throughput; reflected and refracted
+		  rays whose weight falls to the prune threshold or below are not traced.
 	Return:
 		effective color of the pixel after ray tracing.
 	*/
 
 	hit = Hit(FLT_MAX, NULL, Vector3f::ZERO);
+	STATS_ADD(rays, 1);
 
 	if (m_scene->getGroup()->intersect(ray, hit, m_scene->getCamera()->getTMin())) {
+		finalizeHit(ray, hit);
+		return shade(ray, tmin, bounces, refr_index, hit, aov, weight, NULL);
+	}
+	else return m_scene->getBackgroundColor(ray.getDirection());
+}
+
+Vector3f RayTracer::shade( const Ray& ray, float tmin, int bounces, float refr_index, Hit& hit, AOVSample* aov, float weight, const unsigned char* lit ) const {
+	/*
+	Description:
+		Colour of a hit: lights, ambient, then the reflected and refracted rays.
+	Arguments:
+		- ray, tmin, bounces, refr_index, aov, weight: see traceRay.
+		- hit: the nearest hit of ray.
+		- lit: NULL to cast the shadow rays here, or per light whether
+		  the hit point sees it (already tested as a packet).
+	Return:
+		effective color of the pixel after ray tracing.
+	*/
+
+	// declare variables
+	Light* light;
+	Vector3f light_dir;
+	Vector3f light_col;
+	Vector3f pix_col;
+	Vector3f intersect;
+	float dist2light;
+	Vector3f albedo;
+	bool has_albedo = false;
+	std::vector<LightSample> selected;
+	int num_lights;
+
+	// init vectors
+	pix_col = Vector3f::ZERO;
+	intersect = ray.getOrigin() + ray.getDirection() * hit.getT();
+
+	recordHit(aov, ray, hit);
+
+	num_lights = m_scene->getNumLights();
+	if (m_selectLights) {
+		if (shadow_toggle) { selectLights(ray.pointAtParameter(hit.getT()), selected); }
+		num_lights = selected.size();
+	}
+
+	// for loop to get diffuse and specular colors
+	for (int k = 0; k < num_lights; k++) {
 		
-		// declare variables
-		Light* light;
-		Vector3f light_dir;
-		Vector3f light_col;
-		Vector3f pix_col;
-		Vector3f intersect;
-		float dist2light;
-
-		// init vectors
-		pix_col = Vector3f::ZERO;
-		intersect = ray.getOrigin() + ray.getDirection() * hit.getT();
-
-		// for loop to get diffuse and specular colors
-		for (int idx = 0; idx < m_scene->getNumLights(); idx++) {
-			
-			// setting light objects
-			light = m_scene->getLight(idx);
-			light->getIllumination(ray.pointAtParameter(hit.getT()), light_dir, light_col, dist2light);
-
-			// getting shadows
-			if (shadow_toggle) {
+		// setting light objects
+		int idx = m_selectLights ? selected[k].light : k;
+		light = m_scene->getLight(idx);
+		light->getIllumination(ray.pointAtParameter(hit.getT()), light_dir, light_col, dist2light);
+		if (m_selectLights) { light_col = light_col * selected[k].weight; }
+
+		// getting shadows
+		if (shadow_toggle) {
+			bool visible;
+			if (lit != NULL) {
+				visible = lit[idx] != 0;
+			}
+			else {
 				Ray ray_shadow(intersect + light_dir * EPSILON, light_dir);
-				Hit hit_shadow(dist2light, NULL, NULL);
+				STATS_ADD(shadow, 1);
 
-				// checking for ray intersection
-				if (!m_scene->getGroup()->intersect(ray_shadow, hit_shadow, tmin)) {
-					Vector3f shading_col = hit.getMaterial()->Shade(ray, hit, light_dir, light_col);
-					pix_col += shading_col;
+				// checking for any blocker between the point and the light
+				visible = !m_scene->getGroup()->occluded(ray_shadow, tmin, dist2light);
+			}
+			if (visible) {
+				// looked up once, at the first light that reaches the hit
+				if (!has_albedo) {
+					albedo = hit.getMaterial()->getAlbedo(ray, hit);
+					has_albedo = true;
 				}
+				Vector3f shading_col = hit.getMaterial()->Shade(ray, hit, light_dir, light_col, albedo);
+				pix_col += shading_col;
 			}
-
 		}
-		pix_col += hit.getMaterial()->getDiffuseColor() * m_scene->getAmbientLight(); // adding ambient color
 
-		if (bounces > 0) { // checking if there are ray reflections/refractions
+	}
+	pix_col += hit.getMaterial()->getDiffuseColor() * m_scene->getAmbientLight(); // adding ambient color
+
+	if (bounces > 0) { // checking if there are ray reflections/refractions
+
+		// declare variables
+		Branches b;
+		Vector3f reflect_col = Vector3f::ZERO;
+		Vector3f refractColor = Vector3f::ZERO;
+
+		getBranches(ray, hit, refr_index, weight, b);
+
+		// -------------------------- reflection --------------------------
+		if (b.weight_refl > m_pruneThreshold) {
 
-			// -------------------------- reflection --------------------------
 			// declare ray items
 			Vector3f reflect_dir;
 			Hit hit_refl;
-			Vector3f reflect_col;
 
 			// init ray items
 			reflect_dir = mirrorDirection(hit.getNormal().normalized(), ray.getDirection());
 			Ray ray_refl = Ray(intersect + reflect_dir * EPSILON, reflect_dir);
+			bounceDifferentials(ray, hit, refr_index, b.normal, b.refr_index_new, &ray_refl, NULL);
 			hit_refl = Hit(FLT_MAX, NULL, Vector3f::ZERO);
-			reflect_col = traceRay(ray_refl, 0, bounces - 1, refr_index, hit_refl);
-			// ----------------------------------------------------------------
-
-			// -------------------------- refraction --------------------------
-			// init ray items
-			float refr_index_new = hit.getMaterial()->getRefractionIndex();
-			Vector3f normal = (hit.getNormal()).normalized();
-			if (Vector3f::dot(ray.getDirection(), normal) > 0.) { // checking if normal needs to be negated
-				refr_index_new = 1.f; // new refractive index
-				normal = -normal; // negating normal
-			}
-			Vector3f refract_dir(0., 0., 0.); // init refraction direction (updated below)
+			STATS_ADD(reflection, 1);
+			reflect_col = traceRay(ray_refl, 0, bounces - 1, refr_index, hit_refl, aov, b.weight_refl);
+		}
+		else { STATS_ADD(pruned, 1); }
+		// ----------------------------------------------------------------
 
-			// init boolean variable to check for refraction
-			bool refract_on = transmittedDirection(normal, ray.getDirection(), refr_index, refr_index_new, refract_dir);
-			if (refract_on) {
+		// -------------------------- refraction --------------------------
+		if (b.refract_on) {
+			if (b.weight_refr > m_pruneThreshold) {
 
 				// declare ray items
 				Hit hit_refr;
-				Vector3f refractColor;
 
 				// init ray items
-				Ray ray_refr = Ray(intersect + refract_dir * EPSILON, refract_dir);
+				Ray ray_refr = Ray(intersect + b.refract_dir * EPSILON, b.refract_dir);
+				bounceDifferentials(ray, hit, refr_index, b.normal, b.refr_index_new, NULL, &ray_refr);
 				hit_refr = Hit(FLT_MAX, NULL, Vector3f::ZERO);
-				refractColor = traceRay(ray_refr, 0, bounces - 1, refr_index_new, hit_refr);
-
-				// Schlick's approximation
-				float c, R_0, R; 
-				if (refr_index <= refr_index_new) { c = abs(Vector3f::dot(ray.getDirection(), normal)); } 
-				else { c = abs(Vector3f::dot(refract_dir, normal)); }
-				R_0 = pow(((refr_index_new - refr_index) / (refr_index_new + refr_index)), 2); 
-				R = R_0 + (1. - R_0) * pow(1. - c, 5); 
-				pix_col += (1. - R) * hit.getMaterial()->getSpecularColor() * refractColor + R* reflect_col * hit.getMaterial()->getSpecularColor();
+				STATS_ADD(refraction, 1);
+				refractColor = traceRay(ray_refr, 0, bounces - 1, b.refr_index_new, hit_refr, aov, b.weight_refr);
 			}
-			else {
-				pix_col += reflect_col * hit.getMaterial()->getSpecularColor(); // only reflection
+			else { STATS_ADD(pruned, 1); }
+		}
+		// ----------------------------------------------------------------
+
+		addBranches(pix_col, b.spec_col, b.R, b.refract_on, reflect_col, refractColor);
+	}
+
+	return pix_col;
+}
+
+void RayTracer::tracePacket( const Ray* const* rays, int count, float tmin, Vector3f* colors, AOVSample* aovs ) const {
+	/*
+	Description:
+		Traces up to PACKET_SIZE coherent camera rays: the primary hits and
+		the shadow rays towards each light are found as packets, the
+		shading and the reflected/refracted rays are per ray.
+	Arguments:
+		- rays: camera rays, count of them.
+		- tmin: span parameter value for the shadow rays.
+		- colors: receives one colour per ray.
+		- aovs: NULL or one sample per ray.
+	*/
+
+	// declare variables
+	RayPacket packet(rays, count);
+	Hit hits[PACKET_SIZE];
+	Group* group = m_scene->getGroup();
+	int num_lights = m_scene->getNumLights();
+	unsigned char lit_stack[PACKET_SIZE * PACKET_STACK_LIGHTS];
+	std::vector<unsigned char> lit_heap;
+	unsigned char* lit = lit_stack;
+	int found;
+
+	STATS_ADD(rays, count);
+	found = group->intersectPacket(packet, packet.mask, hits, m_scene->getCamera()->getTMin());
+	for (int lane = 0; lane < count; lane++) {
+		if (found & (1 << lane)) { finalizeHit(*rays[lane], hits[lane]); }
+	}
+
+	// ------------------------- shadow packets -------------------------
+	// selected lights differ per lane, shade() then casts its own shadow rays
+	if (shadow_toggle && !m_selectLights && found != 0) {
+		if (num_lights > PACKET_STACK_LIGHTS) {
+			lit_heap.resize(PACKET_SIZE * num_lights);
+			lit = &lit_heap[0];
+		}
+		for (int idx = 0; idx < num_lights; idx++) {
+
+			// declare variables
+			Vector3f light_dir[PACKET_SIZE], light_col;
+			float dist2light[PACKET_SIZE];
+			Vector3f origin[PACKET_SIZE];
+
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				const Ray& ray = *packet.ray[lane];
+				dist2light[lane] = 0.f;
+				origin[lane] = ray.getOrigin();
+				light_dir[lane] = ray.getDirection();
+				if (found & (1 << lane)) {
+					Vector3f intersect = ray.getOrigin() + ray.getDirection() * hits[lane].getT();
+					m_scene->getLight(idx)->getIllumination(ray.pointAtParameter(hits[lane].getT()), light_dir[lane], light_col, dist2light[lane]);
+					origin[lane] = intersect + light_dir[lane] * EPSILON;
+				}
+			}
+			Ray s0(origin[0], light_dir[0]), s1(origin[1], light_dir[1]), s2(origin[2], light_dir[2]), s3(origin[3], light_dir[3]);
+			const Ray* shadow_rays[PACKET_SIZE] = { &s0, &s1, &s2, &s3 };
+
+			int blocked = group->occludedPacket(RayPacket(shadow_rays, PACKET_SIZE), found, tmin, dist2light);
+			for (int lane = 0; lane < PACKET_SIZE; lane++) {
+				lit[lane * num_lights + idx] = !(blocked & (1 << lane));
+				if (found & (1 << lane)) { STATS_ADD(shadow, 1); }
 			}
-			// ----------------------------------------------------------------
 		}
+	}
+	// ------------------------------------------------------------------
 
-		return pix_col;
+	// the lanes that left the scene look up the background together
+	Vector3f escaped_dirs[PACKET_SIZE], escaped_cols[PACKET_SIZE];
+	int num_escaped = 0;
+	for (int lane = 0; lane < count; lane++) {
+		if (!(found & (1 << lane))) { escaped_dirs[num_escaped++] = rays[lane]->getDirection(); }
 	}
-	else return m_scene->getBackgroundColor(ray.getDirection());
+	m_scene->getBackgroundColors(escaped_dirs, num_escaped, escaped_cols);
+
+	num_escaped = 0;
+	for (int lane = 0; lane < count; lane++) {
+		if (found & (1 << lane)) {
+			colors[lane] = shade(*rays[lane], tmin, m_maxBounces, 1.f, hits[lane], aovs != NULL ? &aovs[lane] : NULL, 1.f,
+				shadow_toggle && !m_selectLights ? &lit[lane * num_lights] : NULL);
+		}
+		else {
+			colors[lane] = escaped_cols[num_escaped++];
+		}
+	}
+}
+
+///@brief one ray of the wavefront; children point back at their parent
+///so the colours can be gathered once every stage is done
+struct WaveRay
+{
+	WaveRay( const Ray& r, float tmin, int bounces, float refr_index, float weight, int pixel ) :
+		ray(r), tmin(tmin), bounces(bounces), refr_index(refr_index), weight(weight), pixel(pixel) {
+		found = false;
+		refl_child = -1; refr_child = -1;
+		col = Vector3f::ZERO;
+	}
+
+	Ray ray;
+	Hit hit;
+	float tmin; // for the shadow rays
+	int bounces;
+	float refr_index;
+	float weight;
+	int pixel; // index of the camera ray this ray descends from
+	bool found; // hit something
+	int refl_child, refr_child; // -1 if not traced
+	Vector3f col; // local shading first, the full colour once gathered
+	Vector3f albedo; // of the hit, for every light
+	Vector3f spec_col;
+	float R;
+	bool refract_on;
+};
+
+///@brief shadow ray queued by the shading stage
+struct ShadowRay
+{
+	int ray; // WaveRay that asked for it
+	Vector3f light_dir, light_col;
+	float dist2light;
+};
+
+void RayTracer::traceWavefront( const std::vector<Ray>& rays, float tmin, std::vector<Vector3f>& colors, AOVSample* aovs ) const {
+	/*
+	Description:
+		Traces a batch of camera rays stage by stage: intersect every ray of
+		a bounce, sort the hits by material, queue and test their shadow
+		rays, then queue the reflected and refracted rays as the next stage.
+		The colours are gathered from the deepest rays up, with the same
+		arithmetic as traceRay.
+	Arguments:
+		- rays: camera rays.
+		- tmin: span parameter value for shadow rays of camera hits.
+		- colors: receives one colour per camera ray.
+		- aovs: NULL or one sample per camera ray, filled like traceRay does.
+	*/
+
+	// declare variables
+	std::vector<WaveRay> wave;
+	std::vector<int> order;
+	std::vector<ShadowRay> shadows;
+	std::vector<LightSample> selected;
+	std::vector<const Ray*> run_rays;
+	std::vector<const Hit*> run_hits;
+	std::vector<Vector3f> run_albedos;
+	Group* group = m_scene->getGroup();
+	float cam_tmin = m_scene->getCamera()->getTMin();
+	size_t begin, end;
+
+	wave.reserve(2 * rays.size());
+	for (size_t k = 0; k < rays.size(); k++) {
+		wave.push_back(WaveRay(rays[k], tmin, m_maxBounces, 1.f, 1.f, k));
+	}
+
+	begin = 0; end = wave.size();
+	while (begin < end) {
+
+		// ------------------------- intersection stage -------------------------
+		order.clear();
+		for (size_t k = begin; k < end; k++) {
+			WaveRay& w = wave[k];
+			w.hit = Hit(FLT_MAX, NULL, Vector3f::ZERO);
+			STATS_ADD(rays, 1);
+			w.found = group->intersect(w.ray, w.hit, cam_tmin);
+			if (w.found) {
+				finalizeHit(w.ray, w.hit);
+				order.push_back(k);
+			}
+		}
+
+		// same material next to each other, so shading runs one material at a time
+		std::sort(order.begin(), order.end(), [&wave](int a, int b) {
+			Material* ma = wave[a].hit.getMaterial();
+			Material* mb = wave[b].hit.getMaterial();
+			return ma < mb || (ma == mb && a < b);
+		});
+		// ----------------------------------------------------------------------
+
+		// ------------------------- shading stage -------------------------
+		shadows.clear();
+		for (size_t k = 0; k < order.size(); k++) {
+			WaveRay& w = wave[order[k]];
+			recordHit(aovs != NULL ? &aovs[w.pixel] : NULL, w.ray, w.hit);
+
+			if (!shadow_toggle) { continue; }
+			int num_lights = m_scene->getNumLights();
+			if (m_selectLights) {
+				selectLights(w.ray.pointAtParameter(w.hit.getT()), selected);
+				num_lights = selected.size();
+			}
+			for (int j = 0; j < num_lights; j++) {
+				ShadowRay sr;
+				int idx = m_selectLights ? selected[j].light : j;
+				sr.ray = order[k];
+				m_scene->getLight(idx)->getIllumination(w.ray.pointAtParameter(w.hit.getT()), sr.light_dir, sr.light_col, sr.dist2light);
+				if (m_selectLights) { sr.light_col = sr.light_col * selected[j].weight; }
+				shadows.push_back(sr);
+			}
+		}
+
+		// albedo once per hit, one material at a time so noise is batched
+		for (size_t k = 0; shadow_toggle && k < order.size(); ) {
+			Material* material = wave[order[k]].hit.getMaterial();
+			size_t run_end = k;
+			run_rays.clear(); run_hits.clear();
+			for (; run_end < order.size() && wave[order[run_end]].hit.getMaterial() == material; run_end++) {
+				run_rays.push_back(&wave[order[run_end]].ray);
+				run_hits.push_back(&wave[order[run_end]].hit);
+			}
+			run_albedos.resize(run_rays.size());
+			material->getAlbedos(&run_rays[0], &run_hits[0], run_rays.size(), &run_albedos[0]);
+			for (size_t j = k; j < run_end; j++) { wave[order[j]].albedo = run_albedos[j - k]; }
+			k = run_end;
+		}
+
+		// shadow rays of one hit are queued in light order, so the
+		// colours add up in the same order as in traceRay
+		for (size_t k = 0; k < shadows.size(); k++) {
+			const ShadowRay& sr = shadows[k];
+			WaveRay& w = wave[sr.ray];
+			Vector3f intersect = w.ray.getOrigin() + w.ray.getDirection() * w.hit.getT();
+			Ray ray_shadow(intersect + sr.light_dir * EPSILON, sr.light_dir);
+			STATS_ADD(shadow, 1);
+			if (!group->occluded(ray_shadow, w.tmin, sr.dist2light)) {
+				w.col += w.hit.getMaterial()->Shade(w.ray, w.hit, sr.light_dir, sr.light_col, w.albedo);
+			}
+		}
+		// -----------------------------------------------------------------
+
+		// ------------------------- bounce stage -------------------------
+		for (size_t k = 0; k < order.size(); k++) {
+			int idx = order[k];
+			wave[idx].col += wave[idx].hit.getMaterial()->getDiffuseColor() * m_scene->getAmbientLight(); // adding ambient color
+			if (wave[idx].bounces <= 0) { continue; }
+
+			// declare variables
+			Branches b;
+			Vector3f intersect = wave[idx].ray.getOrigin() + wave[idx].ray.getDirection() * wave[idx].hit.getT();
+
+			getBranches(wave[idx].ray, wave[idx].hit, wave[idx].refr_index, wave[idx].weight, b);
+			wave[idx].spec_col = b.spec_col;
+			wave[idx].R = b.R;
+			wave[idx].refract_on = b.refract_on;
+
+			// push_back may move the wave, so no references are held across it
+			if (b.weight_refl > m_pruneThreshold) {
+				Vector3f reflect_dir = mirrorDirection(wave[idx].hit.getNormal().normalized(), wave[idx].ray.getDirection());
+				Ray ray_refl(intersect + reflect_dir * EPSILON, reflect_dir);
+				bounceDifferentials(wave[idx].ray, wave[idx].hit, wave[idx].refr_index, b.normal, b.refr_index_new, &ray_refl, NULL);
+				wave[idx].refl_child = wave.size();
+				STATS_ADD(reflection, 1);
+				wave.push_back(WaveRay(ray_refl, 0, wave[idx].bounces - 1,
+					wave[idx].refr_index, b.weight_refl, wave[idx].pixel));
+			}
+			else { STATS_ADD(pruned, 1); }
+
+			if (b.refract_on) {
+				if (b.weight_refr > m_pruneThreshold) {
+					Ray ray_refr(intersect + b.refract_dir * EPSILON, b.refract_dir);
+					bounceDifferentials(wave[idx].ray, wave[idx].hit, wave[idx].refr_index, b.normal, b.refr_index_new, NULL, &ray_refr);
+					wave[idx].refr_child = wave.size();
+					STATS_ADD(refraction, 1);
+					wave.push_back(WaveRay(ray_refr, 0, wave[idx].bounces - 1,
+						b.refr_index_new, b.weight_refr, wave[idx].pixel));
+				}
+				else { STATS_ADD(pruned, 1); }
+			}
+		}
+		// ----------------------------------------------------------------
+
+		begin = end; end = wave.size();
+	}
+
+	// ------------------------- gathering -------------------------
+	// background of every ray that left the scene, in one batch
+	std::vector<int> escaped;
+	std::vector<Vector3f> escaped_dirs, escaped_cols;
+	for (size_t k = 0; k < wave.size(); k++) {
+		if (!wave[k].found) {
+			escaped.push_back(k);
+			escaped_dirs.push_back(wave[k].ray.getDirection());
+		}
+	}
+	escaped_cols.resize(escaped.size());
+	m_scene->getBackgroundColors(escaped_dirs.data(), escaped.size(), escaped_cols.data());
+	for (size_t k = 0; k < escaped.size(); k++) {
+		wave[escaped[k]].col = escaped_cols[k];
+	}
+
+	// children always come after their parent
+	for (size_t k = wave.size(); k-- > 0;) {
+		WaveRay& w = wave[k];
+		if (w.found && w.bounces > 0) {
+			addBranches(w.col, w.spec_col, w.R, w.refract_on,
+				w.refl_child >= 0 ? wave[w.refl_child].col : Vector3f::ZERO,
+				w.refr_child >= 0 ? wave[w.refr_child].col : Vector3f::ZERO);
+		}
+	}
+	colors.resize(rays.size());
+	for (size_t k = 0; k < rays.size(); k++) {
+		colors[k] = wave[k].col;
+	}
+	// -------------------------------------------------------------
 }
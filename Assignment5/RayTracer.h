@@ -6,10 +6,10 @@
 #include "SceneParser.h"
 #include "Ray.h"
 #include "Hit.h"
+#include "AOV.h"
 
 class SceneParser;
 
-
 class RayTracer
 {
 public:
@@ -18,17 +18,61 @@ public:
       assert( false );
   }
 
-  RayTracer( SceneParser* scene, int max_bounces, bool shadow_tog); //more arguments as you need...
+  ///@param prune_threshold secondary rays whose weight on the pixel is
+  ///at or below this are not traced (0 only skips zero weight branches)
+  ///@param light_samples point lights picked per hit from the light tree,
+  ///weighted by their estimated contribution; 0 evaluates every light
+  ///that reaches the hit
+  RayTracer( SceneParser* scene, int max_bounces, bool shadow_tog, float prune_threshold = 0.f, int light_samples = 0); //more arguments as you need...
   ~RayTracer();
   
-  Vector3f traceRay( Ray& ray, float tmin, int bounces, float refr_index, Hit& hit ) const;
+  ///@param aov if given, receives the primary hit attributes and counts
+  ///every surface hit of the ray tree; pass the same sample down the tree
+  ///@param weight throughput of the ray, how much its colour counts in the pixel
+  Vector3f traceRay( Ray& ray, float tmin, int bounces, float refr_index, Hit& hit, AOVSample* aov = NULL, float weight = 1.f ) const;
+
+  ///@brief wavefront version of traceRay for a batch of camera rays. The
+  ///rays of one bounce are intersected one by one, then their hits are
+  ///shaded in Material order and queue shadow and bounce rays for the
+  ///next stage.
+  ///Gives the same colours as traceRay on every ray.
+  ///@param aovs NULL or one sample per ray
+  void traceWavefront( const std::vector<Ray>& rays, float tmin, std::vector<Vector3f>& colors, AOVSample* aovs = NULL ) const;
+
+  ///@brief traces up to PACKET_SIZE neighbouring camera rays, finding
+  ///their primary hits and shadow rays as packets. Gives the same colours
+  ///as traceRay on every ray.
+  ///@param aovs NULL or one sample per ray
+  void tracePacket( const Ray* const* rays, int count, float tmin, Vector3f* colors, AOVSample* aovs = NULL ) const;
 
 
 private:
 
+  ///@brief reflection and refraction set-up at a hit, shared by both engines
+  struct Branches
+  {
+    Vector3f spec_col;
+    float R; // Schlick reflectance, 1 without refraction
+    bool refract_on;
+    Vector3f refract_dir;
+    Vector3f normal; // unit, facing the incoming ray
+    float refr_index_new;
+    float weight_refl, weight_refr;
+  };
+
+  void getBranches( const Ray& ray, const Hit& hit, float refr_index, float weight, Branches& b ) const;
+  Vector3f shade( const Ray& ray, float tmin, int bounces, float refr_index, Hit& hit, AOVSample* aov, float weight, const unsigned char* lit ) const;
+  ///@brief lights to shade the point p with, see m_selectLights
+  void selectLights( const Vector3f& p, std::vector<LightSample>& selected ) const;
+
   SceneParser* m_scene;
   int m_maxBounces;
   bool shadow_toggle = false;
+  float m_pruneThreshold;
+  int m_lightSamples;
+  ///@brief lights come from selectLights instead of every scene light:
+  ///set when sampling or when some light has an influence radius
+  bool m_selectLights;
   Group* g;
 
 };
@@ -0,0 +1,157 @@
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// bases of the Halton dimension pairs, two per pair
+static const unsigned int halton_primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53 };
+#define HALTON_PAIRS (sizeof(halton_primes) / sizeof(halton_primes[0]) / 2)
+
+// largest float below 1, sample values are clamped to it
+#define ONE_MINUS_EPSILON 0.99999994f
+
+static unsigned int reverseBits( unsigned int x ) {
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+static unsigned int owenScramble( unsigned int x, unsigned int seed ) {
+	/*
+	Description:
+		Nested uniform scrambling of a 32 bit fixed point value (Burley
+		2020, after Laine and Karras): every bit is flipped depending on
+		the seed and on the bits above it only.
+	*/
+
+	x = reverseBits(x);
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1u;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return reverseBits(x);
+}
+
+///@brief second Sobol dimension as 32 bit fixed point, the first being reverseBits
+static unsigned int sobol2( unsigned int index ) {
+	unsigned int r = 0;
+	for (unsigned int v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+		if (index & 1) { r ^= v; }
+	}
+	return r;
+}
+
+static float toUnit( unsigned int x ) {
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static float radicalInverse( unsigned int index, unsigned int base ) {
+	// declare variables
+	double inv_base = 1. / base, factor = inv_base, r = 0.;
+
+	for (; index > 0; index /= base, factor *= inv_base) {
+		r += (index % base) * factor;
+	}
+	return float(r);
+}
+
+Sampler* Sampler::create( const char* name ) {
+	if (!strcmp(name, "stratified")) { return new StratifiedSampler(); }
+	if (!strcmp(name, "halton")) { return new HaltonSampler(); }
+	if (!strcmp(name, "sobol")) { return new SobolSampler(); }
+	return NULL;
+}
+
+void Sampler::startPixel( int i, int j ) {
+	pixel_i = i;
+	pixel_j = j;
+	randoms.clear();
+	indices.clear();
+}
+
+PixelRandom& Sampler::random( int dimension ) {
+	while ((int)randoms.size() <= dimension) {
+		randoms.push_back(PixelRandom(pixel_i, pixel_j, randoms.size()));
+	}
+	return randoms[dimension];
+}
+
+unsigned int& Sampler::index( int dimension ) {
+	if ((int)indices.size() <= dimension) { indices.resize(dimension + 1, 0); }
+	return indices[dimension];
+}
+
+void StratifiedSampler::next2D( int count, int dimension, Vector2f* points ) {
+	/*
+	Description:
+		Jitters one point inside each cell of the largest square grid that
+		fits count; points left over are uniform over the square.
+	*/
+
+	// declare variables
+	PixelRandom& rng = random(dimension);
+	int strata = int(sqrt(float(count)));
+	int k = 0;
+
+	while ((strata + 1) * (strata + 1) <= count) { strata++; }
+	for (int sx = 0; sx < strata; sx++) {
+		for (int sy = 0; sy < strata; sy++, k++) {
+			points[k][0] = (sx + rng.uniform()) / strata;
+			points[k][1] = (sy + rng.uniform()) / strata;
+		}
+	}
+	for (; k < count; k++) {
+		points[k][0] = rng.uniform();
+		points[k][1] = rng.uniform();
+	}
+}
+
+void HaltonSampler::next2D( int count, int dimension, Vector2f* points ) {
+	/*
+	Description:
+		Continues the Halton points of the dimension pair; pairs past the
+		table of primes wrap around, their offsets still differ.
+	*/
+
+	// declare variables
+	unsigned int& first = index(dimension);
+	PixelRandom offsets(pixel_i, pixel_j, dimension);
+	unsigned int base_x = halton_primes[2 * (dimension % HALTON_PAIRS)];
+	unsigned int base_y = halton_primes[2 * (dimension % HALTON_PAIRS) + 1];
+	float offset_x = offsets.uniform(), offset_y = offsets.uniform();
+
+	for (int k = 0; k < count; k++) {
+		float x = radicalInverse(first + k, base_x) + offset_x;
+		float y = radicalInverse(first + k, base_y) + offset_y;
+		points[k][0] = std::min(x < 1.f ? x : x - 1.f, ONE_MINUS_EPSILON);
+		points[k][1] = std::min(y < 1.f ? y : y - 1.f, ONE_MINUS_EPSILON);
+	}
+	first += count;
+}
+
+void SobolSampler::next2D( int count, int dimension, Vector2f* points ) {
+	/*
+	Description:
+		Takes the batch from the next multiple of count on. The index is
+		scrambled too, which moves the batch to another aligned block of
+		the sequence and decorrelates the dimension pairs.
+	*/
+
+	// declare variables
+	unsigned int& first = index(dimension);
+	PixelRandom seeds(pixel_i, pixel_j, dimension);
+	unsigned int seed_index = seeds.next(), seed_x = seeds.next(), seed_y = seeds.next();
+
+	first = (first + count - 1) / count * count;
+	for (int k = 0; k < count; k++) {
+		unsigned int shuffled = owenScramble(first + k, seed_index);
+		points[k][0] = toUnit(owenScramble(reverseBits(shuffled), seed_x));
+		points[k][1] = toUnit(owenScramble(sobol2(shuffled), seed_y));
+	}
+	first += count;
+}
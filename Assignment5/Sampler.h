@@ -0,0 +1,69 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <vector>
+#include <Vector2f.h>
+
+#include "Random.h"
+
+///@brief sample points in [0,1)^2 for one pixel at a time. Each
+///dimension pair (0 for the position inside the pixel, the next ones for
+///whatever else is sampled per camera sample) has its own sequence, seeded
+///from the pixel and the dimension, so renders are deterministic for any
+///thread count and dimensions are not correlated with each other.
+class Sampler
+{
+public:
+
+	virtual ~Sampler() {}
+
+	///@param name stratified, halton or sobol
+	///@return NULL for an unknown name
+	static Sampler* create( const char* name );
+
+	///@brief restarts every sequence, seeded from pixel (i, j)
+	virtual void startPixel( int i, int j );
+
+	///@brief the next count points of dimension pair dimension; later
+	///calls continue the sequence
+	virtual void next2D( int count, int dimension, Vector2f* points ) = 0;
+
+protected:
+
+	///@brief the random stream of a dimension, created on first use
+	PixelRandom& random( int dimension );
+	///@brief index of the next point of a dimension
+	unsigned int& index( int dimension );
+
+	int pixel_i, pixel_j;
+	std::vector<PixelRandom> randoms;
+	std::vector<unsigned int> indices;
+};
+
+///@brief jittered strata: a square count is split into sqrt(count) x
+///sqrt(count) cells with one uniform point in each, row by row
+class StratifiedSampler : public Sampler
+{
+public:
+	virtual void next2D( int count, int dimension, Vector2f* points );
+};
+
+///@brief Halton sequence in the two prime bases of the dimension pair,
+///shifted modulo 1 by a per pixel random offset (Cranley-Patterson rotation)
+class HaltonSampler : public Sampler
+{
+public:
+	virtual void next2D( int count, int dimension, Vector2f* points );
+};
+
+///@brief the first two Sobol dimensions, Owen scrambled with a per pixel
+///and dimension seed (hash based nested uniform scrambling). Each batch
+///starts at a multiple of its size, so a power of two batch is a complete
+///(0,2)-net: every elementary interval of that area holds one point.
+class SobolSampler : public Sampler
+{
+public:
+	virtual void next2D( int count, int dimension, Vector2f* points );
+};
+
+#endif // SAMPLER_H
@@ -0,0 +1,238 @@
+#include "SceneCache.h"
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char scene_cache_magic[8] = { 'A', '5', 'S', 'C', 'E', 'N', 'E', '\0' };
+
+static const uint32_t scene_cache_sizes[SceneCache::NUM_ARRAYS] = {
+	sizeof(Vector3f), sizeof(Trig), sizeof(Vector3f), sizeof(Vector2f), sizeof(OctNode), sizeof(TrigPack)
+};
+
+static uint64_t alignUp( uint64_t offset ) {
+	return (offset + SCENE_CACHE_ALIGN - 1) / SCENE_CACHE_ALIGN * SCENE_CACHE_ALIGN;
+}
+
+///@brief writes size bytes at offset, zero filling the gap from the current position
+static bool writeAt( FILE* f, uint64_t& position, uint64_t offset, const void* bytes, size_t size ) {
+	static const char zeros[SCENE_CACHE_ALIGN] = {};
+	while (position < offset) {
+		size_t gap = size_t(std::min<uint64_t>(offset - position, SCENE_CACHE_ALIGN));
+		if (fwrite(zeros, 1, gap, f) != gap) { return false; }
+		position += gap;
+	}
+	if (size > 0 && fwrite(bytes, 1, size, f) != size) { return false; }
+	position += size;
+	return true;
+}
+
+///@brief size and modification time of a file, both 0 if it cannot be read
+static void sourceInfo( const char* filename, uint64_t& size, int64_t& time ) {
+	struct stat st;
+	if (stat(filename, &st) != 0) {
+		size = 0;
+		time = 0;
+		return;
+	}
+	size = st.st_size;
+	time = st.st_mtime;
+}
+
+SceneCache::SceneCache() : data(NULL), size(0), header(NULL), meshes(NULL) {}
+
+SceneCache::~SceneCache() {
+	if (data == NULL) { return; }
+#ifdef _WIN32
+	free(const_cast<char*>(data));
+#else
+	munmap(const_cast<char*>(data), size);
+#endif
+}
+
+bool SceneCache::write( const char* filename, const std::string& text, const std::vector<Mesh*>& meshes,
+	const std::vector<std::string>& sources ) {
+	/*
+	Description:
+		Lays out the header, the mesh records, the text and then every
+		mesh's arrays, each aligned to SCENE_CACHE_ALIGN, and writes them
+		in one pass.
+	Arguments:
+		- filename: output file.
+		- text: scene description, parsed again on load.
+		- meshes: every mesh of the scene in parse order, octrees built.
+		- sources: OBJ file of each mesh, its size and time are recorded.
+	Return:
+		false if the file could not be written.
+	*/
+
+	// declare variables
+	Header h = Header();
+	std::vector<MeshRecord> records(meshes.size());
+	uint64_t offset, position = 0;
+	FILE* f;
+	bool ok;
+
+	memcpy(h.magic, scene_cache_magic, sizeof(h.magic));
+	h.version = SCENE_CACHE_VERSION;
+	memcpy(h.sizes, scene_cache_sizes, sizeof(h.sizes));
+	h.numMeshes = meshes.size();
+	h.meshOffset = sizeof(Header);
+	h.textOffset = h.meshOffset + records.size() * sizeof(MeshRecord);
+	h.textSize = text.size();
+
+	// ------------------------- layout -------------------------
+	offset = h.textOffset + text.size() + 1; // keep the text NUL terminated
+	for (size_t k = 0; k < meshes.size(); k++) {
+		const Mesh& m = *meshes[k];
+		MeshRecord& r = records[k];
+		r.count[VERTICES] = m.v.size();
+		r.count[TRIANGLES] = m.t.size();
+		r.count[NORMALS] = m.n.size();
+		r.count[TEX_COORDS] = m.texCoord.size();
+		r.count[NODES] = m.octree.numNodes;
+		r.count[PACKS] = m.octree.numPacks;
+		for (int a = 0; a < NUM_ARRAYS; a++) {
+			offset = alignUp(offset);
+			r.offset[a] = offset;
+			offset += r.count[a] * scene_cache_sizes[a];
+		}
+		sourceInfo(sources[k].c_str(), r.sourceSize, r.sourceTime);
+		r.maxTrig = m.octree.maxTrig;
+		r.maxLevel = m.octree.maxLevel;
+		for (int dim = 0; dim < 3; dim++) {
+			r.box[dim] = m.octree.box.mn[dim];
+			r.box[3 + dim] = m.octree.box.mx[dim];
+		}
+	}
+	// ----------------------------------------------------------
+
+	f = fopen(filename, "wb");
+	if (f == NULL) {
+		std::cout << "Cannot open " << filename << "\n";
+		return false;
+	}
+	ok = writeAt(f, position, 0, &h, sizeof(h));
+	ok = ok && writeAt(f, position, h.meshOffset, records.empty() ? NULL : &records[0], records.size() * sizeof(MeshRecord));
+	ok = ok && writeAt(f, position, h.textOffset, text.c_str(), text.size() + 1);
+	for (size_t k = 0; k < meshes.size() && ok; k++) {
+		const Mesh& m = *meshes[k];
+		const MeshRecord& r = records[k];
+		const void* arrays[NUM_ARRAYS] = { m.v.data(), m.t.data(), m.n.data(), m.texCoord.data(), m.octree.nodeArray, m.octree.packArray };
+		for (int a = 0; a < NUM_ARRAYS && ok; a++) {
+			ok = writeAt(f, position, r.offset[a], arrays[a], r.count[a] * scene_cache_sizes[a]);
+		}
+	}
+	ok = (fclose(f) == 0) && ok;
+	if (!ok) { std::cout << "Cannot write " << filename << "\n"; }
+	return ok;
+}
+
+bool SceneCache::open( const char* filename ) {
+	/*
+	Description:
+		Maps the file read-only, or reads it into memory where mmap is
+		not available, and checks the header against this build.
+	Return:
+		false if the file cannot be read, is truncated or was written
+		by another version or build.
+	*/
+
+#ifdef _WIN32
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL) { return false; }
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	// malloc aligns to 16 bytes, enough for TrigPack
+	char* buffer = (char*)malloc(size > 0 ? size : 1);
+	bool read = buffer != NULL && fread(buffer, 1, size, f) == size;
+	fclose(f);
+	if (!read) { free(buffer); return false; }
+	data = buffer;
+#else
+	struct stat st;
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) { return false; }
+	if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+	size = st.st_size;
+	void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) { return false; }
+	data = (const char*)mapping;
+#endif
+
+	path = filename;
+	header = (const Header*)data;
+	if (size < sizeof(Header) || memcmp(header->magic, scene_cache_magic, sizeof(header->magic)) != 0) {
+		std::cout << filename << " is not a compiled scene\n";
+		return false;
+	}
+	if (header->version != SCENE_CACHE_VERSION || memcmp(header->sizes, scene_cache_sizes, sizeof(header->sizes)) != 0) {
+		std::cout << filename << " was compiled by another version, compile the scene again\n";
+		return false;
+	}
+	meshes = (const MeshRecord*)(data + header->meshOffset);
+	if (header->meshOffset + header->numMeshes * sizeof(MeshRecord) > size || header->textOffset + header->textSize >= size) {
+		std::cout << filename << " is truncated\n";
+		return false;
+	}
+	for (uint32_t k = 0; k < header->numMeshes; k++) {
+		for (int a = 0; a < NUM_ARRAYS; a++) {
+			if (meshes[k].offset[a] + meshes[k].count[a] * scene_cache_sizes[a] > size) {
+				std::cout << filename << " is truncated\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+Mesh* SceneCache::loadMesh( int index, Material* material, const char* source ) const {
+	/*
+	Description:
+		Points the arrays and the octree of a mesh at the stored ones.
+		The stored mesh is used even if source has changed, only with a
+		warning.
+	Arguments:
+		- source: OBJ file the scene text gives for the mesh.
+	Return:
+		the mesh, or NULL if index is past the stored meshes.
+	*/
+
+	if (index < 0 || index >= (int)header->numMeshes) { return NULL; }
+
+	// declare variables
+	const MeshRecord& r = meshes[index];
+	Mesh* m = new Mesh(material, r.maxTrig, r.maxLevel);
+	const Vector3f* v = (const Vector3f*)(data + r.offset[VERTICES]);
+	const Trig* t = (const Trig*)(data + r.offset[TRIANGLES]);
+	const Vector3f* n = (const Vector3f*)(data + r.offset[NORMALS]);
+	const Vector2f* tex = (const Vector2f*)(data + r.offset[TEX_COORDS]);
+	uint64_t source_size;
+	int64_t source_time;
+
+	sourceInfo(source, source_size, source_time);
+	if (source_size != r.sourceSize || source_time != r.sourceTime) {
+		std::cout << "WARNING: " << source << " has changed since " << path << " was compiled, compile the scene again\n";
+	}
+	m->v.view(v, r.count[VERTICES]);
+	m->t.view(t, r.count[TRIANGLES]);
+	m->n.view(n, r.count[NORMALS]);
+	m->texCoord.view(tex, r.count[TEX_COORDS]);
+	m->octree.box = Box(r.box[0], r.box[1], r.box[2], r.box[3], r.box[4], r.box[5]);
+	m->octree.useArrays((const OctNode*)(data + r.offset[NODES]), r.count[NODES],
+		(const TrigPack*)(data + r.offset[PACKS]), r.count[PACKS]);
+	return m;
+}
@@ -0,0 +1,86 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Mesh;
+class Material;
+
+// bump whenever the layout of the file or of a stored struct changes
+#define SCENE_CACHE_VERSION 3
+// every array starts on a cache line, so packs can be used in place
+#define SCENE_CACHE_ALIGN 64
+
+///@brief compiled scene (-compile-scene): the scene text together with
+///every unique mesh's vertices, triangles, normals, texture coordinates
+///and built octree, in the order they first appear. Loading maps the
+///file and points the meshes straight at it, so no OBJ is parsed, no
+///octree is built and no mesh array is copied. Each mesh records the
+///size and modification time of its OBJ to warn when it has changed.
+///The file is in native byte order and only valid for the build that
+///wrote it; the header records the struct sizes to catch mismatches.
+class SceneCache
+{
+public:
+
+	enum Array { VERTICES, TRIANGLES, NORMALS, TEX_COORDS, NODES, PACKS, NUM_ARRAYS };
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t sizes[NUM_ARRAYS]; // element size of each array
+		uint32_t numMeshes;
+		uint64_t textOffset, textSize;
+		uint64_t meshOffset; // numMeshes MeshRecords
+	};
+
+	struct MeshRecord
+	{
+		uint64_t offset[NUM_ARRAYS];
+		uint64_t count[NUM_ARRAYS];
+		uint64_t sourceSize; // OBJ file when compiled
+		int64_t sourceTime;
+		int32_t maxTrig, maxLevel;
+		float box[6]; // octree box, min then max
+	};
+
+	SceneCache();
+	~SceneCache();
+
+	///@brief writes text and meshes to filename, sources being the OBJ
+	///file of each mesh
+	///@return false if the file could not be written
+	static bool write( const char* filename, const std::string& text, const std::vector<Mesh*>& meshes,
+		const std::vector<std::string>& sources );
+
+	///@brief maps a file written by write()
+	///@return false if it cannot be read or was written by another version
+	bool open( const char* filename );
+
+	///@brief the scene text stored in the file
+	const char* getText() const { return data + header->textOffset; }
+	size_t getTextSize() const { return header->textSize; }
+	int getNumMeshes() const { return header->numMeshes; }
+
+	///@brief unique mesh number index, in order of first appearance; its arrays and octree
+	///point into the mapping, so the cache must outlive it. Warns if source, its OBJ file,
+	///is not the one it was compiled from.
+	Mesh* loadMesh( int index, Material* material, const char* source ) const;
+
+private:
+
+	SceneCache( const SceneCache& ) = delete;
+	SceneCache& operator=( const SceneCache& ) = delete;
+
+	std::string path;
+	const char* data;
+	size_t size;
+	const Header* header;
+	const MeshRecord* meshes;
+};
+
+#endif // SCENE_CACHE_H
@@ -15,10 +15,26 @@
 #include "Plane.h"
 #include "Triangle.h"
 #include "Transform.h"
+#include "SceneCache.h"
+#include "PerlinNoise.h"
 
 #define DegreesToRadians(x) ((M_PI * x) / 180.0f)
 
-SceneParser::SceneParser(const char* filename) {
+// the tokenizer reads a FILE, so scene text held in memory is handed to it as one
+static FILE* openText(const std::string& text) {
+#ifdef _WIN32
+    FILE* f = tmpfile();
+    if (f != NULL) {
+        fwrite(text.c_str(), 1, text.size(), f);
+        rewind(f);
+    }
+    return f;
+#else
+    return fmemopen(const_cast<char*>(text.c_str()), text.size(), "r");
+#endif
+}
+
+SceneParser::SceneParser(const char* filename, int num_threads) {
 
     // initialize some reasonable default values
     group = NULL;
@@ -30,17 +46,41 @@ SceneParser::SceneParser(const char* filename) {
     num_materials = 0;
     materials = NULL;
     current_material = NULL;
+    current_material_index = -1;
+    current_transform = Matrix4f::identity();
 	cubemap = 0;
+    cache = NULL;
+    build_threads = num_threads;
     // parse the file
     assert(filename != NULL);
     const char *ext = &filename[strlen(filename)-4];
 
-    if(strcmp(ext,".txt")!=0){
+    if(strcmp(ext,".txt")!=0 && strcmp(ext,".bin")!=0){
 		printf("wrong file name extension\n");
 		exit(0);
 	}
-    file = fopen(filename,"r");
-
+    if(strcmp(ext,".bin")==0){
+        // compiled scene: the text comes from the file, the meshes are mapped
+        cache = new SceneCache();
+        if (!cache->open(filename)){
+            printf("cannot open compiled scene file\n");
+            exit(0);
+        }
+        text.assign(cache->getText(), cache->getTextSize());
+    } else {
+        file = fopen(filename,"r");
+        if (file == NULL){
+            printf("cannot open scene file\n");
+            exit(0);
+        }
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            text.append(buffer, count);
+        }
+        fclose(file);
+    }
+    file = openText(text);
 	if (file == NULL){
 		printf("cannot open scene file\n");
 		exit(0);
@@ -49,6 +89,11 @@ SceneParser::SceneParser(const char* filename) {
     fclose(file); 
     file = NULL;
 
+    // noise asked to be baked covers the objects using its material
+    for (int i = 0; i < num_materials; i++) {
+        materials[i]->bakeNoise(material_bounds[i]);
+    }
+
     // if no lights are specified, set ambient light to white
     // (do solid color ray casting)
     if (num_lights == 0) {
@@ -69,6 +114,12 @@ SceneParser::~SceneParser() {
     for (i = 0; i < num_lights; i++) {
         delete lights[i]; }
     delete [] lights;
+    // mapped meshes point into the cache
+    delete cache;
+}
+
+bool SceneParser::compile(const char* filename) const {
+    return SceneCache::write(filename, text, meshes, mesh_files);
 }
 
 // ====================================================================
@@ -173,6 +224,7 @@ void SceneParser::parseLights() {
         count++;
     }
     getToken(token); assert (!strcmp(token, "}"));
+    light_tree.build(lights, num_lights);
 }
 
 
@@ -190,6 +242,7 @@ Light* SceneParser::parsePointLight() {
     char token[MAX_PARSER_TOKEN_LENGTH];
     Vector3f position,color;
     float falloff =0;
+    float radius = 0;
     getToken(token); assert (!strcmp(token, "{"));
     while (1) {
         getToken(token); 
@@ -199,12 +252,14 @@ Light* SceneParser::parsePointLight() {
           color = readVector3f();
         }else if(strcmp(token,"falloff")==0){    
           falloff = readFloat();
+        }else if(strcmp(token,"radius")==0){
+          radius = readFloat();
         }else{
            assert (!strcmp(token, "}"));
           break;
         }
     }
-    return new PointLight(position,color,falloff);
+    return new PointLight(position,color,falloff,radius);
 }
 // ====================================================================
 // ====================================================================
@@ -216,6 +271,7 @@ void SceneParser::parseMaterials() {
     getToken(token); assert (!strcmp(token, "numMaterials"));
     num_materials = readInt();
     materials = new Material*[num_materials];
+    material_bounds.assign(num_materials, Box::empty());
     // read in the objects
     int count = 0;
     while (num_materials > count) {
@@ -288,6 +344,7 @@ Noise * SceneParser::parseNoise()
 	int octaves=0;
 	float frequency  = 1;
 	float amplitude = 1;
+	int bake = 0;
 	getToken(token); assert (!strcmp(token, "{"));
 	Noise *noise =0;
     while (1) {
@@ -308,13 +365,22 @@ Noise * SceneParser::parseNoise()
         }
 		else if (strcmp(token, "amplitude")==0) {
             amplitude= readFloat();
+        }
+		else if (strcmp(token, "bake")==0) {
+            bake= readInt();
         }
 		else {
             assert (!strcmp(token, "}"));
             break;
         }
     }
-	return new Noise(octaves, color[0],color[1],frequency,amplitude);
+	if (octaves > PERLIN_MAX_OCTAVES) {
+		printf ("WARNING:    Noise octaves %d, only the first %d are used\n", octaves, PERLIN_MAX_OCTAVES);
+		octaves = PERLIN_MAX_OCTAVES;
+	}
+	noise = new Noise(octaves, color[0],color[1],frequency,amplitude);
+	noise->bakeResolution = bake;
+	return noise;
 }
 // ====================================================================
 // ====================================================================
@@ -330,13 +396,40 @@ Object3D* SceneParser::parseObject(char token[MAX_PARSER_TOKEN_LENGTH]) {
     } else if (!strcmp(token, "Triangle")) {            
         answer = (Object3D*)parseTriangle();
     } else if (!strcmp(token, "TriangleMesh")) {            
-        answer = (Object3D*)parseTriangleMesh();
+        Mesh *mesh = parseTriangleMesh();
+        answer = (Object3D*)mesh;
+        // a mesh shared with an earlier placement keeps its first material
+        if (mesh->getMaterial() != current_material) {
+            Transform *instance = new Transform(Matrix4f::identity(), mesh);
+            instance->setInstanceMaterial(current_material);
+            answer = (Object3D*)instance;
+        }
     } else if (!strcmp(token, "Transform")) {            
         answer = (Object3D*)parseTransform();
     } else {
         printf ("Unknown token in parseObject: '%s'\n", token);
         exit(0);
     }
+    // noise is evaluated at world space points, so its bake covers the
+    // world space boxes of the primitives; groups and transforms only
+    // hold primitives that were added already
+    Box box;
+    if (current_material_index >= 0 && strcmp(token, "Group") && strcmp(token, "Transform")
+        && answer->getBoundingBox(box)) {
+        material_bounds[current_material_index].extend(worldBox(box));
+    }
+    return answer;
+}
+
+Box SceneParser::worldBox(const Box& box) const {
+    // bounding box of the 8 corners moved by every enclosing Transform
+    Box answer = Box::empty();
+    for (int k = 0; k < 8; k++) {
+        Vector4f corner((k & 4) ? box.mx.x() : box.mn.x(),
+                        (k & 2) ? box.mx.y() : box.mn.y(),
+                        (k & 1) ? box.mx.z() : box.mn.z(), 1.);
+        answer.extend((current_transform * corner).xyz());
+    }
     return answer;
 }
 
@@ -370,15 +463,16 @@ Group* SceneParser::parseGroup() {
             int index = readInt();
             assert (index >= 0 && index <= getNumMaterials());
             current_material = getMaterial(index);
+            current_material_index = index;
         } else {
             Object3D *object = parseObject(token);
             assert (object != NULL);
             answer->addObject(count,object);
-	    
             count++;
         }
     }
     getToken(token); assert (!strcmp(token, "}"));
+    answer->buildBVH();
     
     // return the group
     return answer;
@@ -437,10 +531,46 @@ Mesh* SceneParser::parseTriangleMesh() {
     getToken(token); assert (!strcmp(token, "{"));
     getToken(token); assert (!strcmp(token, "obj_file"));
     getToken(filename); 
-    getToken(token); assert (!strcmp(token, "}"));
+    // optional octree settings
+    int max_trig = OCTREE_MAX_TRIG;
+    int max_level = OCTREE_MAX_LEVEL;
+    getToken(token);
+    while (strcmp(token, "}")) {
+        if (!strcmp(token, "octree_max_trig")) {
+            max_trig = readInt();
+        } else if (!strcmp(token, "octree_max_level")) {
+            max_level = readInt();
+        } else {
+            printf ("Unknown token in parseTriangleMesh: '%s'\n", token);
+            exit(0);
+        }
+        getToken(token);
+    }
     const char *ext = &filename[strlen(filename)-4];
     assert(!strcmp(ext,".obj"));
-    Mesh *answer = new Mesh(filename,current_material);
+
+    // placed before: share it, the caller gives it its own material if needed
+    char key[3 * MAX_PARSER_TOKEN_LENGTH];
+    snprintf(key, sizeof(key), "%s %d %d", filename, max_trig, max_level);
+    std::map<std::string, Mesh*>::iterator shared = mesh_cache.find(key);
+    if (shared != mesh_cache.end()) {
+        return shared->second;
+    }
+
+    Mesh *answer;
+    if (cache != NULL) {
+        // unique meshes are stored in the order they first appear
+        answer = cache->loadMesh(meshes.size(), current_material, filename);
+        if (answer == NULL) {
+            printf ("Compiled scene holds fewer meshes than its text\n");
+            exit(0);
+        }
+    } else {
+        answer = new Mesh(filename,current_material,max_trig,max_level,build_threads);
+    }
+    meshes.push_back(answer);
+    mesh_files.push_back(filename);
+    mesh_cache[key] = answer;
     
     return answer;
 }
@@ -492,7 +622,10 @@ Transform* SceneParser::parseTransform() {
         } else {
             // otherwise this must be an object,
             // and there are no more transformations
+            Matrix4f parent = current_transform;
+            current_transform = parent * matrix;
             object = parseObject(token);
+            current_transform = parent;
             break;
         }
         getToken(token);
@@ -500,7 +633,19 @@ Transform* SceneParser::parseTransform() {
 
     assert(object != NULL);
     getToken(token); assert (!strcmp(token, "}"));
-    return new Transform(matrix, object);
+
+    // collapse directly nested transforms into a single matrix
+    Transform *inner = dynamic_cast<Transform*>(object);
+    Material *instance_material = NULL;
+    if (inner != NULL) {
+        matrix = matrix * inner->getMatrix();
+        object = inner->getObject();
+        instance_material = inner->getMaterial();
+        delete inner;
+    }
+    Transform *answer = new Transform(matrix, object);
+    answer->setInstanceMaterial(instance_material);
+    return answer;
 }
 
 // ====================================================================
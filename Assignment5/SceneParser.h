@@ -2,12 +2,16 @@
 #define SCENE_PARSER_H
 
 #include <cassert>
+#include <map>
+#include <string>
+#include <vector>
 #include <vecmath.h>
 
 #include "SceneParser.h"
 #include "Camera.h"
 #include "CubeMap.h"
 #include "Light.h"
+#include "LightTree.h"
 #include "Material.h"
 #include "Object3D.h"
 #include "Mesh.hpp"
@@ -31,11 +35,14 @@ class Transform;
 #define MAX_PARSER_TOKEN_LENGTH 100
 #define M_PI 3.14159265359
 
+class SceneCache;
+
 class SceneParser
 {
 public:
 
-    SceneParser( const char* filename );
+    ///@param num_threads threads building mesh octrees, 0 for every hardware thread
+    SceneParser( const char* filename, int num_threads = 0 );
     ~SceneParser();
 
     Camera* getCamera() const
@@ -51,6 +58,17 @@ public:
 		return cubemap->operator()(dir);
     }
 
+    ///@brief getBackgroundColor for count directions, e.g. the rays of a
+    ///packet or a wavefront that left the scene
+    void getBackgroundColors(const Vector3f* dirs, int count, Vector3f* colors) const
+    {
+		if(cubemap == 0){
+			std::fill(colors, colors + count, background_color);
+			return;
+		}
+		cubemap->lookup(dirs, count, colors);
+    }
+
     Vector3f getAmbientLight() const
     {
         return ambient_light;
@@ -67,6 +85,12 @@ public:
         return lights[i];
     }
 
+    ///@brief hierarchy over the point lights, for culling and light selection
+    const LightTree& getLightTree() const
+    {
+        return light_tree;
+    }
+
     int getNumMaterials() const
     {
         return num_materials;
@@ -83,6 +107,11 @@ public:
         return group;
     }
 
+    ///@brief writes the scene text and every mesh with its octree to a
+    ///compiled scene, which the constructor loads again from a .bin file
+    ///@return false if the file could not be written
+    bool compile( const char* filename ) const;
+
 private:
 
     SceneParser()
@@ -107,6 +136,8 @@ private:
     Triangle* parseTriangle();
     Mesh* parseTriangleMesh();
     Transform* parseTransform();
+    ///@brief box of the object being parsed, in world space
+    Box worldBox( const Box& box ) const;
 	CubeMap * parseCubeMap();
     int getToken( char token[ MAX_PARSER_TOKEN_LENGTH ] );
     Vector3f readVector3f();
@@ -120,11 +151,31 @@ private:
     Vector3f ambient_light;
     int num_lights;
     Light** lights;
+    LightTree light_tree;
     int num_materials;
     Material** materials;
     Material* current_material;
+    int current_material_index;
+    ///@brief bounds of the objects using each material, for baking noise
+    std::vector<Box> material_bounds;
+    ///@brief world from the frame of the object being parsed, the
+    ///product of the enclosing Transforms
+    Matrix4f current_transform;
     Group* group;
 	CubeMap * cubemap;
+    ///@brief the scene description, kept for compile()
+    std::string text;
+    ///@brief every unique triangle mesh, in the order they first appear
+    std::vector<Mesh*> meshes;
+    ///@brief obj file of each of meshes
+    std::vector<std::string> mesh_files;
+    ///@brief meshes by obj file and octree settings, so a file placed
+    ///several times is loaded and its octree built once
+    std::map<std::string, Mesh*> mesh_cache;
+    ///@brief threads building mesh octrees, 0 for every hardware thread
+    int build_threads;
+    ///@brief set while loading a compiled scene
+    SceneCache* cache;
 };
 
 #endif // SCENE_PARSER_H
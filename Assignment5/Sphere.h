@@ -2,6 +2,7 @@
 #define SPHERE_H
 
 #include "Object3D.h"
+#include "Stats.h"
 #include <vecmath.h>
 #include <cmath>
 
@@ -27,6 +28,8 @@ public:
 		double a, b, c, discriminant, t;
 		Vector3f r_o, r_d, normal;
 
+		STATS_ADD(sphereTests, 1);
+
 		// computing vectors
 		r_o = r.getOrigin() - this->center;
 		r_d = r.getDirection(); r_d.normalize(); // ensure r_d is normalized
@@ -42,32 +45,145 @@ public:
 
 			t = (-b - sqrt(discriminant)) / (2. * a); // computing root (-)
 			if (t >= tmin && t <= h.getT()) {
-
-				// computing normal
-				normal = (r.getOrigin() + t * r_d - this->center);
-				normal.normalized();
-
-				h.set(t, this->material, normal);
+				h.record(t, this, 0, 0.f, 0.f, 0.f);
 				return true;
 			}
 
 			t = (-b + sqrt(discriminant)) / (2. * a); // computing root (+)
 			if (t >= tmin && t <= h.getT()) {
+				h.record(t, this, 0, 0.f, 0.f, 0.f);
+				return true;
+			}
+		}
+		return false;
+	}
 
-				// computing normal
-				normal = (r.getOrigin() + t * r_d - this->center);
-				normal.normalized();
+	virtual void finalizeHit( const Ray& r , Hit& h ) const {
 
-				h.set(t, this->material, normal); 
-				return true;
+		// declaring variables
+		Vector3f r_d, normal;
+
+		// computing normal (left unnormalized, shading normalizes it)
+		r_d = r.getDirection(); r_d.normalize();
+		normal = (r.getOrigin() + h.getT() * r_d - this->center);
+		h.set(h.getT(), this->material, normal);
+	}
+
+	virtual bool occluded( const Ray& r , float tmin , float tmax ){
+
+		// declaring variables
+		double a, b, c, discriminant, t;
+		Vector3f r_o, r_d;
+
+		STATS_ADD(sphereTests, 1);
+
+		// computing vectors
+		r_o = r.getOrigin() - this->center;
+		r_d = r.getDirection(); r_d.normalize(); // ensure r_d is normalized
+
+		// computing root finding parameters
+		a = r_d.absSquared();
+		b = 2. * Vector3f::dot(r_d, r_o);
+		c = r_o.absSquared() - pow(this->radius, 2.);
+		discriminant = pow(b, 2.) - (4. * a * c);
+
+		if (discriminant < 0.) { return false; }
+
+		t = (-b - sqrt(discriminant)) / (2. * a); // computing root (-)
+		if (t >= tmin && t <= tmax) { return true; }
+		t = (-b + sqrt(discriminant)) / (2. * a); // computing root (+)
+		return t >= tmin && t <= tmax;
+	}
+
+#ifdef RAY_PACKET_SSE
+	virtual int intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin ){
+
+		// declaring variables
+		double t_minus[PACKET_SIZE], t_plus[PACKET_SIZE], t;
+		int result = 0;
+
+		STATS_ADD(sphereTests, RayPacket::laneCount(mask));
+		mask &= roots(p, t_minus, t_plus);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if (!(mask & (1 << lane))) { continue; }
+
+			// nearest root in range, as in intersect
+			t = t_minus[lane];
+			if (!(t >= tmin && t <= hits[lane].getT())) {
+				t = t_plus[lane];
+				if (!(t >= tmin && t <= hits[lane].getT())) { continue; }
 			}
+
+			hits[lane].record(t, this, 0, 0.f, 0.f, 0.f);
+			result |= 1 << lane;
 		}
-		else {
-			return false;
+		return result;
+	}
+
+	virtual int occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax ){
+
+		// declaring variables
+		double t_minus[PACKET_SIZE], t_plus[PACKET_SIZE];
+		int result = 0;
+
+		STATS_ADD(sphereTests, RayPacket::laneCount(mask));
+		mask &= roots(p, t_minus, t_plus);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if (!(mask & (1 << lane))) { continue; }
+			if ((t_minus[lane] >= tmin && t_minus[lane] <= tmax[lane]) || (t_plus[lane] >= tmin && t_plus[lane] <= tmax[lane])) {
+				result |= 1 << lane;
+			}
 		}
+		return result;
+	}
+#endif
+
+	virtual bool getBoundingBox(Box& box) const {
+		Vector3f r(radius, radius, radius);
+		box = Box(center - r, center + r);
+		return true;
 	}
 
 protected:
+
+#ifdef RAY_PACKET_SSE
+	///@brief both roots for four rays, with the same float and double
+	///steps as intersect so that packets and single rays agree exactly
+	///@return mask of the lanes with a non-negative discriminant
+	int roots( const RayPacket& p , double t_minus[4] , double t_plus[4] ) const {
+
+		// normalized directions and origins relative to the center
+		__m128 dx = _mm_load_ps(p.d[0]), dy = _mm_load_ps(p.d[1]), dz = _mm_load_ps(p.d[2]);
+		__m128 norm = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		dx = _mm_div_ps(dx, norm); dy = _mm_div_ps(dy, norm); dz = _mm_div_ps(dz, norm);
+		__m128 ox = _mm_sub_ps(_mm_load_ps(p.o[0]), _mm_set1_ps(center[0]));
+		__m128 oy = _mm_sub_ps(_mm_load_ps(p.o[1]), _mm_set1_ps(center[1]));
+		__m128 oz = _mm_sub_ps(_mm_load_ps(p.o[2]), _mm_set1_ps(center[2]));
+
+		__m128 a4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 b4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ox), _mm_mul_ps(dy, oy)), _mm_mul_ps(dz, oz));
+		__m128 c4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz));
+
+		// the root finding runs in double, two lanes at a time
+		int valid = 0;
+		for (int half = 0; half < 2; half++) {
+			__m128d a = _mm_cvtps_pd(a4), b = _mm_cvtps_pd(b4), c = _mm_cvtps_pd(c4);
+			b = _mm_mul_pd(_mm_set1_pd(2.), b);
+			c = _mm_sub_pd(c, _mm_set1_pd(double(radius) * double(radius)));
+			__m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(4.), a), c));
+			__m128d root = _mm_sqrt_pd(disc);
+			__m128d minus_b = _mm_xor_pd(b, _mm_set1_pd(-0.));
+			__m128d two_a = _mm_mul_pd(_mm_set1_pd(2.), a);
+			_mm_storeu_pd(t_minus + 2 * half, _mm_div_pd(_mm_sub_pd(minus_b, root), two_a));
+			_mm_storeu_pd(t_plus + 2 * half, _mm_div_pd(_mm_add_pd(minus_b, root), two_a));
+			valid |= _mm_movemask_pd(_mm_cmpge_pd(disc, _mm_setzero_pd())) << (2 * half);
+
+			a4 = _mm_movehl_ps(a4, a4); b4 = _mm_movehl_ps(b4, b4); c4 = _mm_movehl_ps(c4, c4);
+		}
+		return valid;
+	}
+#endif
+
 	Vector3f center; // sphere center coordinate
 	float radius; // sphere radius
 
@@ -0,0 +1,129 @@
+#include "Stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+
+bool Stats::enabled = false;
+bool Stats::skipped = false;
+double Stats::times[Stats::NUM_PHASES] = {};
+std::vector<ThreadStats> Stats::threads(1);
+thread_local ThreadStats* Stats::current = &Stats::threads[0];
+
+static const char* phase_names[Stats::NUM_PHASES] = { "parse", "obj_load", "octree_build", "render", "filter", "save" };
+
+void Stats::reserveThreads( int n ) {
+	/*
+	Description:
+		Grows the blocks to n, keeping their counts. No worker may be
+		running; the calling thread is moved along to its new block.
+	*/
+
+	if (n <= (int)threads.size()) { return; }
+	size_t own = current - &threads[0];
+	threads.resize(n, ThreadStats());
+	current = &threads[own];
+}
+
+void Stats::bindThread( int thread_id ) {
+	/*
+	Description:
+		Points the calling thread's counters at block thread_id, which
+		only this thread writes while it renders.
+	*/
+
+	assert(thread_id >= 0 && thread_id < (int)threads.size());
+	current = &threads[thread_id];
+}
+
+void Stats::addTime( Phase phase, double seconds ) {
+	times[phase] += seconds;
+}
+
+ThreadStats Stats::total() {
+
+	// declare variables
+	ThreadStats sum = ThreadStats();
+
+	for (size_t k = 0; k < threads.size(); k++) {
+		const ThreadStats& s = threads[k];
+		sum.rays += s.rays;
+		sum.reflection += s.reflection; sum.refraction += s.refraction;
+		sum.shadow += s.shadow;
+		sum.pruned += s.pruned;
+		sum.nodesVisited += s.nodesVisited;
+		sum.trigTests += s.trigTests; sum.sphereTests += s.sphereTests;
+		sum.leavesVisited += s.leavesVisited; sum.leavesSkipped += s.leavesSkipped;
+		sum.trigsSkipped += s.trigsSkipped;
+		sum.busy += s.busy;
+	}
+	return sum;
+}
+
+///@brief rays traced per second of busy time
+static double raysPerSecond( const ThreadStats& s ) {
+	return s.busy > 0 ? (s.rays + s.shadow) / s.busy : 0.;
+}
+
+void Stats::print() {
+
+	// declare variables
+	ThreadStats sum = total();
+
+	std::cout << "phases (s):";
+	for (int p = 0; p < NUM_PHASES; p++) {
+		std::cout << " " << phase_names[p] << " " << times[p];
+	}
+	std::cout << "\n";
+
+	std::cout << "rays traced " << sum.rays << " (primary " << sum.rays - sum.reflection - sum.refraction << ", reflection " << sum.reflection
+		<< ", refraction " << sum.refraction << "), shadow rays " << sum.shadow << ", pruned " << sum.pruned << "\n";
+	std::cout << "nodes visited " << sum.nodesVisited << ", triangle tests " << sum.trigTests << ", sphere tests " << sum.sphereTests << "\n";
+	std::cout << "octree leaves visited " << sum.leavesVisited;
+	if (skipped) { std::cout << ", skipped " << sum.leavesSkipped << ", triangles skipped " << sum.trigsSkipped; }
+	std::cout << "\n";
+
+	for (size_t k = 0; k < threads.size(); k++) {
+		std::cout << "thread " << k << ": " << threads[k].rays + threads[k].shadow << " rays in " << threads[k].busy << " s, "
+			<< raysPerSecond(threads[k]) << " rays/s\n";
+	}
+}
+
+bool Stats::saveJSON( const char* filename ) {
+
+	// declare variables
+	FILE* f = fopen(filename, "w");
+	ThreadStats sum = total();
+
+	if (f == NULL) {
+		std::cout << "Cannot open " << filename << "\n";
+		return false;
+	}
+
+	fprintf(f, "{\n  \"phases\": {");
+	for (int p = 0; p < NUM_PHASES; p++) {
+		fprintf(f, "%s\"%s\": %.6f", p ? ", " : "", phase_names[p], times[p]);
+	}
+	fprintf(f, "},\n");
+
+	fprintf(f, "  \"rays\": {\"primary\": %lld, \"reflection\": %lld, \"refraction\": %lld, \"shadow\": %lld, \"pruned\": %lld},\n",
+		sum.rays - sum.reflection - sum.refraction, sum.reflection, sum.refraction, sum.shadow, sum.pruned);
+	fprintf(f, "  \"traversal\": {\"nodes_visited\": %lld, \"triangle_tests\": %lld, \"sphere_tests\": %lld, \"octree_leaves_visited\": %lld",
+		sum.nodesVisited, sum.trigTests, sum.sphereTests, sum.leavesVisited);
+	if (skipped) {
+		fprintf(f, ", \"octree_leaves_skipped\": %lld, \"triangles_skipped\": %lld", sum.leavesSkipped, sum.trigsSkipped);
+	}
+	fprintf(f, "},\n");
+
+	fprintf(f, "  \"threads\": [");
+	for (size_t k = 0; k < threads.size(); k++) {
+		const ThreadStats& s = threads[k];
+		fprintf(f, "%s\n    {\"rays\": %lld, \"shadow\": %lld, \"nodes_visited\": %lld, \"busy\": %.6f, \"rays_per_second\": %.1f}",
+			k ? "," : "", s.rays, s.shadow, s.nodesVisited, s.busy, raysPerSecond(s));
+	}
+	fprintf(f, "\n  ]\n}\n");
+
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <vector>
+
+// counters are compiled in unless the build defines NO_STATS
+#ifndef NO_STATS
+#define RT_STATS
+#endif
+
+///@brief counters of one render thread. Only the owning thread writes
+///them, so they need no atomics; -stats sums them after rendering.
+struct alignas(64) ThreadStats
+{
+	long long rays; // every traced camera, reflection and refraction ray
+	long long reflection, refraction, shadow;
+	long long pruned; // secondary rays skipped for their low weight
+	long long nodesVisited; // BVH and octree nodes
+	long long trigTests, sphereTests;
+	long long leavesVisited, leavesSkipped, trigsSkipped; // octree, see Stats::skipped
+	double busy; // seconds spent on tiles
+};
+
+///@brief -stats: phase timings and per-thread ray and traversal counters
+class Stats
+{
+public:
+
+	enum Phase { PARSE, OBJ_LOAD, OCTREE_BUILD, RENDER, FILTER, SAVE, NUM_PHASES };
+
+	///@brief counters are only updated while enabled
+	static bool enabled;
+	///@brief also walk the octree cells behind the nearest hit to count
+	///them, which costs a full traversal
+	static bool skipped;
+
+	///@brief counter block of the calling thread
+	static ThreadStats& local() { return *current; }
+	///@brief gives threads 0 to n-1 a block each; call before starting
+	///them, as growing moves the blocks
+	static void reserveThreads( int n );
+	///@brief makes the calling thread count into block thread_id, which
+	///must have been reserved
+	static void bindThread( int thread_id );
+
+	///@brief adds seconds to a phase; OBJ_LOAD and OCTREE_BUILD are part of PARSE
+	static void addTime( Phase phase, double seconds );
+	static double getTime( Phase phase ) { return times[phase]; }
+
+	///@brief sum over all threads
+	static ThreadStats total();
+
+	static void print();
+	///@brief writes the phases, totals and per-thread counters as JSON
+	///@return false if filename could not be opened
+	static bool saveJSON( const char* filename );
+
+	///@brief adds its lifetime to a phase
+	class Timer
+	{
+	public:
+		Timer( Phase phase ) : phase(phase), start(std::chrono::steady_clock::now()) {}
+		~Timer() { Stats::addTime(phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()); }
+	private:
+		Phase phase;
+		std::chrono::steady_clock::time_point start;
+	};
+
+private:
+
+	static double times[NUM_PHASES];
+	static std::vector<ThreadStats> threads;
+	static thread_local ThreadStats* current;
+};
+
+#ifdef RT_STATS
+#define STATS_ADD(counter, n) do { if (Stats::enabled) { Stats::local().counter += (n); } } while (0)
+#else
+#define STATS_ADD(counter, n) do {} while (0)
+#endif
+
+#endif // STATS_H
@@ -0,0 +1,93 @@
+#include "TileScheduler.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+TileScheduler::TileScheduler( int width, int height, int tile_size, int num_threads ) {
+	/*
+	Description:
+		Cuts the image into tiles.
+	Arguments:
+		- width, height: size of the image in pixels.
+		- tile_size: edge length of a square tile.
+		- num_threads: number of worker threads (0 for one per hardware thread).
+	*/
+
+	if (num_threads <= 0) {
+		num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	this->num_threads = num_threads;
+	queues = std::vector<Queue>(num_threads);
+
+	for (int y = 0; y < height; y += tile_size) {
+		for (int x = 0; x < width; x += tile_size) {
+			Tile tile = { x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) };
+			tiles.push_back(tile);
+		}
+	}
+}
+
+bool TileScheduler::nextTile( int thread_id, Tile& tile ) {
+	/*
+	Description:
+		Pops a tile from the worker's own queue, or steals one from another worker.
+	Return:
+		false once every queue is empty.
+	*/
+
+	{
+		Queue& own = queues[thread_id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.tiles.empty()) {
+			tile = own.tiles.front();
+			own.tiles.pop_front();
+			return true;
+		}
+	}
+
+	for (int k = 1; k < num_threads; k++) {
+		Queue& victim = queues[(thread_id + k) % num_threads];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tiles.empty()) {
+			tile = victim.tiles.back();
+			victim.tiles.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+void TileScheduler::worker( int thread_id, const std::function<void( const Tile&, int )>& func ) {
+	Tile tile;
+	Stats::bindThread(thread_id);
+	while (nextTile(thread_id, tile)) {
+		if (!Stats::enabled) { func(tile, thread_id); continue; }
+		auto start = std::chrono::steady_clock::now();
+		func(tile, thread_id);
+		Stats::local().busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void TileScheduler::run( const std::function<void( const Tile&, int )>& func ) {
+
+	// deal contiguous runs of tiles to each worker, so neighbouring
+	// (coherent) tiles start out on the same core
+	for (int t = 0; t < num_threads; t++) {
+		queues[t].tiles.clear();
+	}
+	for (size_t k = 0; k < tiles.size(); k++) {
+		queues[k * num_threads / tiles.size()].tiles.push_back(tiles[k]);
+	}
+
+	Stats::reserveThreads(num_threads);
+	std::vector<std::thread> threads;
+	for (int t = 1; t < num_threads; t++) {
+		threads.push_back(std::thread(&TileScheduler::worker, this, t, std::cref(func)));
+	}
+	worker(0, func); // the calling thread does its share too
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
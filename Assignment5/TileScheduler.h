@@ -0,0 +1,47 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+///@brief rectangular block of pixels [x0,x1) x [y0,y1)
+struct Tile
+{
+	int x0, y0, x1, y1;
+};
+
+///@brief splits an image into tiles and hands them out to worker
+///threads. Every worker owns a queue of tiles; once it runs dry it
+///steals from the back of the other workers' queues.
+class TileScheduler
+{
+public:
+
+	///@param num_threads 0 picks the number of hardware threads
+	TileScheduler( int width, int height, int tile_size = 16, int num_threads = 1 );
+
+	///@brief calls func(tile, thread_id) for every tile and returns
+	///once the whole image is done
+	void run( const std::function<void( const Tile&, int )>& func );
+
+	int getNumThreads() const { return num_threads; }
+
+private:
+
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Tile> tiles;
+	};
+
+	bool nextTile( int thread_id, Tile& tile );
+	void worker( int thread_id, const std::function<void( const Tile&, int )>& func );
+
+	int num_threads;
+	std::vector<Tile> tiles;
+	std::vector<Queue> queues;
+};
+
+#endif // TILE_SCHEDULER_H
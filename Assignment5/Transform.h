@@ -3,9 +3,13 @@
 
 #include <vecmath.h>
 #include "Object3D.h"
-///TODO implement this class
-///So that the intersect function first transforms the ray
-///Add more fields as necessary
+///@brief wraps an object with a transformation matrix. The inverse and
+///the normal matrix are computed once on construction; rays are moved
+///into object space with a 3x4 affine fast path unless the matrix is
+///projective. Traversal only notes the Transform on the hit; the normal
+///is moved to world space by finalizeHit, once per nearest hit.
+///Several Transforms may share one object (instancing); a Transform can
+///then also give its instance a material of its own.
 class Transform: public Object3D
 {
 public: 
@@ -13,44 +17,174 @@ public:
 	Transform( const Matrix4f& m, Object3D* obj ) : o(obj) {
 		this->matrix = m;
 		this->o = obj;
+		this->inv = m.inverse();
+
+		// affine unless the bottom row says otherwise
+		affine = m(3, 0) == 0.f && m(3, 1) == 0.f && m(3, 2) == 0.f && m(3, 3) == 1.f;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 4; j++) {
+				inv_rows[i][j] = inv(i, j);
+			}
+			// normal matrix: upper 3x3 of the inverse transpose
+			for (int j = 0; j < 3; j++) {
+				normal_rows[i][j] = inv(j, i);
+			}
+		}
 	} // constructor
 	~Transform(){} // destructor
 
+	const Matrix4f& getMatrix() const { return matrix; }
+	Object3D* getObject() const { return o; }
+	///@brief material for hits below this Transform, replacing the one
+	///of the shared object; NULL (the default) keeps the object's own
+	void setInstanceMaterial( Material* m ) { material = m; }
+
 	virtual bool intersect( const Ray& r , Hit& h , float tmin){
 		
-		// declare variables
-		Vector3f r_o_trans3, r_d_trans3;
-		Vector4f r_o, r_d, r_o_trans4, r_d_trans4;
-		
-		// computing transformed ray
-		r_o = Vector4f(r.getOrigin(), 1.); r_d = Vector4f(r.getDirection(), 0.); // original points
-		r_o_trans4 = this->matrix.inverse() * r_o; r_d_trans4 = this->matrix.inverse() * r_d; // transformed points
-		r_o_trans3 = r_o_trans4.xyz(); r_d_trans3 = r_d_trans4.xyz(); // transformed vectors
-		Ray ray(r_o_trans3, r_d_trans3); // new (transformed) ray
-		
+		Ray ray = toObject(r, false); // new (transformed) ray
 
 		if (this->o->intersect(ray, h, tmin)) {
-
-			// declaring variables
-			Vector4f normal_trans4, normal4;
-			Vector3f normal_trans3;
-			
-			normal4 = Vector4f(h.getNormal(), 0.); // original normal as a point
-			normal_trans4 = (this->matrix.inverse().transposed() * normal4).normalized(); // transformed normal point
-			normal_trans3 = normal_trans4.xyz(); // transformed normal vector
-			h.set(h.getT(), h.getMaterial(), normal_trans3); // setting new normal
-			
+			h.pushTransform(this); // normal is set by finalizeHit
 			return true;
 		}
 		else {
 			return false;
 		}
-		//return o->intersect( r , h , tmin);
+	}
+
+	virtual bool occluded( const Ray& r , float tmin , float tmax ){
+		// t is unchanged because the direction is not renormalized
+		return this->o->occluded(toObject(r, false), tmin, tmax);
+	}
+
+	virtual int intersectPacket( const RayPacket& p , int mask , Hit* hits , float tmin ){
+
+		// transformed packet
+		Ray r0 = toObject(*p.ray[0], false), r1 = toObject(*p.ray[1], false), r2 = toObject(*p.ray[2], false), r3 = toObject(*p.ray[3], false);
+		const Ray* rays[PACKET_SIZE] = { &r0, &r1, &r2, &r3 };
+		RayPacket local(rays, PACKET_SIZE);
+
+		int result = this->o->intersectPacket(local, mask, hits, tmin);
+		for (int lane = 0; lane < PACKET_SIZE; lane++) {
+			if (result & (1 << lane)) { hits[lane].pushTransform(this); }
+		}
+		return result;
+	}
+
+	virtual int occludedPacket( const RayPacket& p , int mask , float tmin , const float* tmax ){
+		Ray r0 = toObject(*p.ray[0], false), r1 = toObject(*p.ray[1], false), r2 = toObject(*p.ray[2], false), r3 = toObject(*p.ray[3], false);
+		const Ray* rays[PACKET_SIZE] = { &r0, &r1, &r2, &r3 };
+		return this->o->occludedPacket(RayPacket(rays, PACKET_SIZE), mask, tmin, tmax);
+	}
+
+	virtual bool getBoundingBox(Box& box) const {
+
+		// declare variables
+		Box local;
+
+		if (!this->o->getBoundingBox(local)) { return false; }
+
+		// bounding box of the 8 transformed corners
+		box = Box::empty();
+		for (int k = 0; k < 8; k++) {
+			Vector4f corner((k & 4) ? local.mx.x() : local.mn.x(),
+							(k & 2) ? local.mx.y() : local.mn.y(),
+							(k & 1) ? local.mx.z() : local.mn.z(), 1.);
+			box.extend((this->matrix * corner).xyz());
+		}
+		return true;
+	}
+
+	///@brief moves a world space ray into object space
+	///@param differentials also move its differentials, which only
+	///finalizeHit needs
+	Ray toObject( const Ray& r, bool differentials ) const {
+
+		if (!affine) {
+			Vector4f r_o = inv * Vector4f(r.getOrigin(), 1.);
+			Vector4f r_d = inv * Vector4f(r.getDirection(), 0.);
+			Ray ray(r_o.xyz(), r_d.xyz());
+			if (differentials && r.hasDifferentials()) { ray.setDifferentials(toObject(r.getDifferentials())); }
+			return ray;
+		}
+
+		// declare variables
+		const Vector3f& p = r.getOrigin();
+		const Vector3f& d = r.getDirection();
+		Vector3f r_o, r_d;
+
+		// the trailing + 0.f turns a -0 component into +0 like the full
+		// product does, so axis-aligned rays keep their traversal order
+		for (int i = 0; i < 3; i++) {
+			r_o[i] = inv_rows[i][0] * p[0] + inv_rows[i][1] * p[1] + inv_rows[i][2] * p[2] + inv_rows[i][3];
+			r_d[i] = inv_rows[i][0] * d[0] + inv_rows[i][1] * d[1] + inv_rows[i][2] * d[2] + 0.f;
+		}
+		Ray ray(r_o, r_d);
+		if (differentials && r.hasDifferentials()) { ray.setDifferentials(toObject(r.getDifferentials())); }
+		return ray;
+	}
+
+	///@brief differentials are offsets, so only the linear part applies
+	RayDifferentials toObject( const RayDifferentials& d ) const {
+		RayDifferentials local;
+		const Vector3f* in[4] = { &d.dOdx, &d.dOdy, &d.dDdx, &d.dDdy };
+		Vector3f* out[4] = { &local.dOdx, &local.dOdy, &local.dDdx, &local.dDdy };
+		for (int k = 0; k < 4; k++) {
+			for (int i = 0; i < 3; i++) {
+				(*out[k])[i] = inv(i, 0) * (*in[k])[0] + inv(i, 1) * (*in[k])[1] + inv(i, 2) * (*in[k])[2];
+			}
+		}
+		return local;
+	}
+
+	///@brief moves the normal of an object space hit into world space
+	void toWorld( Hit& h ) const {
+
+		// declaring variables
+		Vector3f n, normal_trans3;
+
+		n = h.getNormal(); // object space normal
+		for (int i = 0; i < 3; i++) {
+			normal_trans3[i] = normal_rows[i][0] * n[0] + normal_rows[i][1] * n[1] + normal_rows[i][2] * n[2];
+		}
+		h.set(h.getT(), h.getMaterial(), normal_trans3.normalized());
 	}
 
  protected:
+
 	Object3D* o; // un-transformed object	
 	Matrix4f matrix;
+	Matrix4f inv; // cached inverse
+	float inv_rows[3][4]; // top three rows of the inverse
+	float normal_rows[3][3]; // inverse transpose for normals
+	bool affine;
 };
 
+///@brief fills in the material, normal and texture coordinates of the
+///nearest hit of ray, once traversal is done: the primitive that recorded
+///it works in its own space, then each Transform above it moves the
+///normal out, innermost first
+inline void finalizeHit( const Ray& ray, Hit& hit ) {
+
+	if (hit.getObject() == NULL) { return; }
+
+	// declare variables
+	Ray local = ray;
+
+	for (int k = hit.getNumTransforms() - 1; k >= 0; k--) {
+		local = hit.getTransform(k)->toObject(local, true);
+	}
+	hit.getObject()->finalizeHit(local, hit);
+	// the instance nearest the primitive decides the material
+	for (int k = 0; k < hit.getNumTransforms(); k++) {
+		if (hit.getTransform(k)->getMaterial() != NULL) {
+			hit.setMaterial(hit.getTransform(k)->getMaterial());
+			break;
+		}
+	}
+	for (int k = 0; k < hit.getNumTransforms(); k++) {
+		hit.getTransform(k)->toWorld(hit);
+	}
+}
+
 #endif //TRANSFORM_H
@@ -2,6 +2,7 @@
 #define TRIANGLE_H
 
 #include "Object3D.h"
+#include "Stats.h"
 #include <vecmath.h>
 #include <cmath>
 #include <iostream>
@@ -36,7 +37,52 @@ public:
 	virtual bool intersect( const Ray& ray,  Hit& hit , float tmin) {
 		
 		// declaring variables
-		double alpha, beta, gamma, t, detA;
+		double alpha, beta, gamma, t;
+
+		STATS_ADD(trigTests, 1);
+
+		// computing barycentric coordinates and ray parameter
+		if (!intersectBarycentric(this->a, this->b, this->c, ray, alpha, beta, gamma, t)) { return false; }
+
+		if (t > tmin && t < hit.getT()) {
+			hit.record(t, this, 0, alpha, beta, gamma);
+			return true;
+		}
+		return false;
+	}
+
+	virtual void finalizeHit( const Ray& ray, Hit& hit ) const {
+
+		// declaring variables
+		const float* bary = hit.getBarycentrics();
+		Vector3f normal;
+		Vector2f texture;
+
+		normal = (bary[0] * this->normals[0] + bary[1] * this->normals[1] + bary[2] * this->normals[2]).normalized();
+		hit.set(hit.getT(), this->material, normal);
+		texture = (bary[0] * this->texCoords[0] + bary[1] * this->texCoords[1] + bary[2] * this->texCoords[2]);
+		hit.setTexCoord(texture);
+		if (hasTex) { texDifferentials(this->a, this->b, this->c, this->texCoords, ray, hit.getT(), hit); }
+	}
+
+	virtual bool occluded( const Ray& ray, float tmin, float tmax ) {
+
+		// declaring variables
+		double alpha, beta, gamma, t;
+
+		STATS_ADD(trigTests, 1);
+		if (!intersectBarycentric(this->a, this->b, this->c, ray, alpha, beta, gamma, t)) { return false; }
+		return t > tmin && t < tmax;
+	}
+
+	///@brief ray/triangle test on raw vertex positions, shared with Mesh
+	///so that meshes do not build a Triangle object for every test
+	///@return false if the ray misses the triangle (t is not range checked)
+	static bool intersectBarycentric( const Vector3f& a, const Vector3f& b, const Vector3f& c, const Ray& ray,
+		double& alpha, double& beta, double& gamma, double& t ) {
+
+		// declaring variables
+		double detA;
 		Vector3f r_o, r_d;
 		Matrix3f A, A_1, A_2, A_3;
 
@@ -45,18 +91,18 @@ public:
 		r_d = ray.getDirection(); // ray direction
 
 		// barycentric matrices
-		A = Matrix3f(this->a.x() - this->b.x(), this->a.x() - this->c.x(), r_d.x(),
-					this->a.y() - this->b.y(), this->a.y() - this->c.y(), r_d.y(),
-					this->a.z() - this->b.z(), this->a.z() - this->c.z(), r_d.z());
-		A_1 = Matrix3f(this->a.x() - r_o.x(), this->a.x() - this->c.x(), r_d.x(),
-						this->a.y() - r_o.y(), this->a.y() - this->c.y(), r_d.y(),
-						this->a.z() - r_o.z(), this->a.z() - this->c.z(), r_d.z());
-		A_2 = Matrix3f(this->a.x() - this->b.x(), this->a.x() - r_o.x(), r_d.x(),
-						this->a.y() - this->b.y(), this->a.y() - r_o.y(), r_d.y(),
-						this->a.z() - this->b.z(), this->a.z() - r_o.z(), r_d.z());
-		A_3 = Matrix3f(this->a.x() - this->b.x(), this->a.x() - this->c.x(), this->a.x() - r_o.x(),
-			this->a.y() - this->b.y(), this->a.y() - this->c.y(), this->a.y() - r_o.y(),
-			this->a.z() - this->b.z(), this->a.z() - this->c.z(), this->a.z() - r_o.z());
+		A = Matrix3f(a.x() - b.x(), a.x() - c.x(), r_d.x(),
+					a.y() - b.y(), a.y() - c.y(), r_d.y(),
+					a.z() - b.z(), a.z() - c.z(), r_d.z());
+		A_1 = Matrix3f(a.x() - r_o.x(), a.x() - c.x(), r_d.x(),
+						a.y() - r_o.y(), a.y() - c.y(), r_d.y(),
+						a.z() - r_o.z(), a.z() - c.z(), r_d.z());
+		A_2 = Matrix3f(a.x() - b.x(), a.x() - r_o.x(), r_d.x(),
+						a.y() - b.y(), a.y() - r_o.y(), r_d.y(),
+						a.z() - b.z(), a.z() - r_o.z(), r_d.z());
+		A_3 = Matrix3f(a.x() - b.x(), a.x() - c.x(), a.x() - r_o.x(),
+			a.y() - b.y(), a.y() - c.y(), a.y() - r_o.y(),
+			a.z() - b.z(), a.z() - c.z(), a.z() - r_o.z());
 
 		// computing barycentric coordinates and ray parameter
 		detA = A.determinant(); // determinant of A
@@ -66,22 +112,40 @@ public:
 		t = A_3.determinant() / detA;
 
 		// ignoring undefined instances
-		if (beta < 0. || gamma < 0. || (beta + gamma) > 1.) { return false; }
-
-		if (t > tmin && t < hit.getT()) {
+		return !(beta < 0. || gamma < 0. || (beta + gamma) > 1.);
+	}
 
-			// declaring variables
-			Vector3f normal;
-			Vector2f texture;
+	///@brief turns the ray differentials into texture coordinate
+	///derivatives on the hit at t, shared with Mesh
+	static void texDifferentials( const Vector3f& a, const Vector3f& b, const Vector3f& c, const Vector2f* tex,
+		const Ray& ray, float t, Hit& hit ) {
 
-			normal = (alpha * this->normals[0] + beta * this->normals[1] + gamma * this->normals[2]).normalized();
-			hit.set(t, this->material, normal);
-			texture = (alpha * this->texCoords[0] + beta * this->texCoords[1] + gamma * this->texCoords[2]);
-			hit.setTexCoord(texture);
+		// declaring variables
+		Vector3f e1, e2, n, dPdx, dPdy, beta_grad, gamma_grad;
+		Vector2f dtb, dtc;
+		float nn;
+
+		e1 = b - a;
+		e2 = c - a;
+		n = Vector3f::cross(e1, e2);
+		nn = Vector3f::dot(n, n);
+		if (nn == 0.f || !ray.transferDifferentials(t, n, dPdx, dPdy)) { return; }
+
+		// beta = dot(P - a, e2 x n) / |n|^2 and gamma = dot(P - a, n x e1) / |n|^2
+		beta_grad = Vector3f::cross(e2, n) / nn;
+		gamma_grad = Vector3f::cross(n, e1) / nn;
+		dtb = tex[1] - tex[0];
+		dtc = tex[2] - tex[0];
+		hit.setTexDifferentials(Vector3f::dot(dPdx, beta_grad) * dtb + Vector3f::dot(dPdx, gamma_grad) * dtc,
+			Vector3f::dot(dPdy, beta_grad) * dtb + Vector3f::dot(dPdy, gamma_grad) * dtc);
+	}
 
-			return true;
-		}
-		return false;
+	virtual bool getBoundingBox(Box& box) const {
+		box = Box::empty();
+		box.extend(a);
+		box.extend(b);
+		box.extend(c);
+		return true;
 	}
 
 	void setTex(const Vector2f& uva, const Vector2f& uvb, const Vector2f& uvc) {
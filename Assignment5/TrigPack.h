@@ -0,0 +1,183 @@
+#ifndef TRIG_PACK_H
+#define TRIG_PACK_H
+
+#include <Vector3f.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRIG_PACK_SSE
+#endif
+
+///@brief four triangles in structure-of-arrays layout, precomputed at
+///load time for the Moller-Trumbore test: one vertex and the two edges
+///leaving it. Unused lanes have id -1 and zero edges, so they never hit.
+struct alignas(16) TrigPack
+{
+	float v0[3][4];
+	float e1[3][4];
+	float e2[3][4];
+	int id[4];
+
+	TrigPack(){
+		for(int dim = 0; dim < 3; dim++){
+			for(int lane = 0; lane < 4; lane++){
+				v0[dim][lane] = e1[dim][lane] = e2[dim][lane] = 0;
+			}
+		}
+		for(int lane = 0; lane < 4; lane++){
+			id[lane] = -1;
+		}
+	}
+
+	void set(int lane, int trig, const Vector3f & a, const Vector3f & b, const Vector3f & c){
+		for(int dim = 0; dim < 3; dim++){
+			v0[dim][lane] = a[dim];
+			e1[dim][lane] = b[dim] - a[dim];
+			e2[dim][lane] = c[dim] - a[dim];
+		}
+		id[lane] = trig;
+	}
+
+	///@brief tests all four triangles against one ray
+	///@param t, u, v per lane ray parameter and barycentrics of b and c
+	///@return bit k set if lane k is hit with tmin < t < tmax
+	int intersect(const Vector3f & o, const Vector3f & d, float tmin, float tmax,
+		float t[4], float u[4], float v[4]) const;
+
+	///@brief tests triangle k against four rays in structure-of-arrays
+	///layout (see RayPacket), with the same arithmetic as intersect()
+	///@param t, u, v per ray lane ray parameter and barycentrics of b and c
+	///@return bit r set if ray r hits with tmin < t < tmax[r]
+	int intersectRays(int k, const float o[3][4], const float d[3][4], float tmin, const float tmax[4],
+		float t[4], float u[4], float v[4]) const;
+};
+
+inline int TrigPack::intersect(const Vector3f & o, const Vector3f & d, float tmin, float tmax,
+	float t[4], float u[4], float v[4]) const
+{
+#ifdef TRIG_PACK_SSE
+	const __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+	const __m128 e1x = _mm_load_ps(e1[0]), e1y = _mm_load_ps(e1[1]), e1z = _mm_load_ps(e1[2]);
+	const __m128 e2x = _mm_load_ps(e2[0]), e2y = _mm_load_ps(e2[1]), e2z = _mm_load_ps(e2[2]);
+
+	// p = d x e2, det = e1 . p
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	// s = o - v0, u = s . p / det
+	__m128 sx = _mm_sub_ps(_mm_set1_ps(o[0]), _mm_load_ps(v0[0]));
+	__m128 sy = _mm_sub_ps(_mm_set1_ps(o[1]), _mm_load_ps(v0[1]));
+	__m128 sz = _mm_sub_ps(_mm_set1_ps(o[2]), _mm_load_ps(v0[2]));
+	__m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+	// q = s x e1, v = d . q / det, t = e2 . q / det
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+	__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 mask = _mm_cmpneq_ps(det, zero);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, _mm_set1_ps(tmin)));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_set1_ps(tmax)));
+
+	_mm_storeu_ps(t, tt);
+	_mm_storeu_ps(u, uu);
+	_mm_storeu_ps(v, vv);
+	return _mm_movemask_ps(mask);
+#else
+	int hits = 0;
+	for(int lane = 0; lane < 4; lane++){
+		float px = d[1]*e2[2][lane] - d[2]*e2[1][lane];
+		float py = d[2]*e2[0][lane] - d[0]*e2[2][lane];
+		float pz = d[0]*e2[1][lane] - d[1]*e2[0][lane];
+		float det = e1[0][lane]*px + e1[1][lane]*py + e1[2][lane]*pz;
+		float inv = 1.0f/det;
+		float sx = o[0]-v0[0][lane], sy = o[1]-v0[1][lane], sz = o[2]-v0[2][lane];
+		u[lane] = (sx*px + sy*py + sz*pz)*inv;
+		float qx = sy*e1[2][lane] - sz*e1[1][lane];
+		float qy = sz*e1[0][lane] - sx*e1[2][lane];
+		float qz = sx*e1[1][lane] - sy*e1[0][lane];
+		v[lane] = (d[0]*qx + d[1]*qy + d[2]*qz)*inv;
+		t[lane] = (e2[0][lane]*qx + e2[1][lane]*qy + e2[2][lane]*qz)*inv;
+		if(det != 0 && u[lane] >= 0 && v[lane] >= 0 && u[lane] + v[lane] <= 1
+			&& t[lane] > tmin && t[lane] < tmax){
+			hits |= 1 << lane;
+		}
+	}
+	return hits;
+#endif
+}
+
+inline int TrigPack::intersectRays(int k, const float o[3][4], const float d[3][4], float tmin, const float tmax[4],
+	float t[4], float u[4], float v[4]) const
+{
+#ifdef TRIG_PACK_SSE
+	const __m128 dx = _mm_loadu_ps(d[0]), dy = _mm_loadu_ps(d[1]), dz = _mm_loadu_ps(d[2]);
+	const __m128 e1x = _mm_set1_ps(e1[0][k]), e1y = _mm_set1_ps(e1[1][k]), e1z = _mm_set1_ps(e1[2][k]);
+	const __m128 e2x = _mm_set1_ps(e2[0][k]), e2y = _mm_set1_ps(e2[1][k]), e2z = _mm_set1_ps(e2[2][k]);
+
+	// p = d x e2, det = e1 . p
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	// s = o - v0, u = s . p / det
+	__m128 sx = _mm_sub_ps(_mm_loadu_ps(o[0]), _mm_set1_ps(v0[0][k]));
+	__m128 sy = _mm_sub_ps(_mm_loadu_ps(o[1]), _mm_set1_ps(v0[1][k]));
+	__m128 sz = _mm_sub_ps(_mm_loadu_ps(o[2]), _mm_set1_ps(v0[2][k]));
+	__m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+	// q = s x e1, v = d . q / det, t = e2 . q / det
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+	__m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 mask = _mm_cmpneq_ps(det, zero);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, _mm_set1_ps(tmin)));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_loadu_ps(tmax)));
+
+	_mm_storeu_ps(t, tt);
+	_mm_storeu_ps(u, uu);
+	_mm_storeu_ps(v, vv);
+	return _mm_movemask_ps(mask);
+#else
+	int hits = 0;
+	for(int lane = 0; lane < 4; lane++){
+		float px = d[1][lane]*e2[2][k] - d[2][lane]*e2[1][k];
+		float py = d[2][lane]*e2[0][k] - d[0][lane]*e2[2][k];
+		float pz = d[0][lane]*e2[1][k] - d[1][lane]*e2[0][k];
+		float det = e1[0][k]*px + e1[1][k]*py + e1[2][k]*pz;
+		float inv = 1.0f/det;
+		float sx = o[0][lane]-v0[0][k], sy = o[1][lane]-v0[1][k], sz = o[2][lane]-v0[2][k];
+		u[lane] = (sx*px + sy*py + sz*pz)*inv;
+		float qx = sy*e1[2][k] - sz*e1[1][k];
+		float qy = sz*e1[0][k] - sx*e1[2][k];
+		float qz = sx*e1[1][k] - sy*e1[0][k];
+		v[lane] = (d[0][lane]*qx + d[1][lane]*qy + d[2][lane]*qz)*inv;
+		t[lane] = (e2[0][k]*qx + e2[1][k]*qy + e2[2][k]*qz)*inv;
+		if(det != 0 && u[lane] >= 0 && v[lane] >= 0 && u[lane] + v[lane] <= 1
+			&& t[lane] > tmin && t[lane] < tmax[lane]){
+			hits |= 1 << lane;
+		}
+	}
+	return hits;
+#endif
+}
+
+#endif // TRIG_PACK_H
@@ -0,0 +1,246 @@
+// Scene benchmark: renders every sceneNN_*.txt with the ray tracer at a
+// fixed size, bounce count and sampling, repeats each run and reports the
+// median wall time, rays/second, acceleration build time and peak RSS.
+// Each image is checked against bench/reference with Image::compare and
+// the results are written as JSON.
+//
+//   make bench
+//   ./scene_bench [-renderer ./all] [-size 200 200] [-repeat 3] [-threads 1]
+//                 [-tolerance 0] [-output bench_results.json] [-update]
+//                 [-- extra renderer arguments]
+//
+// -update overwrites the references with this run's images.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../Image.h"
+
+using namespace std;
+
+#define BENCH_REFERENCE_DIR "bench/reference"
+#define BENCH_OUT_DIR "bench/out"
+// everything but the size and threads is fixed, so runs stay comparable
+#define BENCH_BOUNCES "4"
+
+///@brief one render of one scene
+struct Run
+{
+	double wall; // whole process, seconds
+	double parse, build, render, filter; // phases reported by -stats-json
+	long long rays;
+	long peak_rss; // kilobytes
+};
+
+///@brief first number after "key": in a -stats-json file, 0 if missing
+static double jsonNumber( const string& text, const char* key ) {
+	string pattern = string("\"") + key + "\": ";
+	size_t pos = text.find(pattern);
+	return pos == string::npos ? 0. : atof(text.c_str() + pos + pattern.size());
+}
+
+static double median( vector<double> values ) {
+	sort(values.begin(), values.end());
+	size_t n = values.size();
+	return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+static bool render( const vector<string>& args, Run& run ) {
+	/*
+	Description:
+		Runs the renderer once with its output silenced.
+	Arguments:
+		- args: renderer path followed by its arguments.
+		- run: receives the wall time and peak RSS; the phases are read
+		  from the stats file afterwards.
+	Return:
+		false if the renderer could not be started or failed.
+	*/
+
+	// declare variables
+	vector<char*> argv;
+	struct rusage usage;
+	int status;
+
+	for (size_t k = 0; k < args.size(); k++) { argv.push_back(const_cast<char*>(args[k].c_str())); }
+	argv.push_back(NULL);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	pid_t pid = fork();
+	if (pid < 0) { return false; }
+	if (pid == 0) {
+		int null_fd = open("/dev/null", O_WRONLY);
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		execv(argv[0], &argv[0]);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, &usage) < 0) { return false; }
+	run.wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	run.peak_rss = usage.ru_maxrss;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main( int argc, char* argv[] )
+{
+	// declaring variables for argument parsing
+	string renderer = "./all";
+	string output_filename = "bench_results.json";
+	int width = 200, height = 200;
+	int repeat = 3;
+	int num_threads = 1;
+	int tolerance = 0; // largest accepted channel difference, in 8 bit levels
+	bool update = false;
+	vector<string> extra_args;
+
+	for (int k = 1; k < argc; k++) {
+		if (!strcmp(argv[k], "-renderer") && k + 1 < argc) { renderer = argv[++k]; }
+		else if (!strcmp(argv[k], "-size") && k + 2 < argc) { width = atoi(argv[++k]); height = atoi(argv[++k]); }
+		else if (!strcmp(argv[k], "-repeat") && k + 1 < argc) { repeat = max(1, atoi(argv[++k])); }
+		else if (!strcmp(argv[k], "-threads") && k + 1 < argc) { num_threads = atoi(argv[++k]); }
+		else if (!strcmp(argv[k], "-tolerance") && k + 1 < argc) { tolerance = atoi(argv[++k]); }
+		else if (!strcmp(argv[k], "-output") && k + 1 < argc) { output_filename = argv[++k]; }
+		else if (!strcmp(argv[k], "-update")) { update = true; }
+		else if (!strcmp(argv[k], "--")) {
+			for (k++; k < argc; k++) { extra_args.push_back(argv[k]); }
+		}
+		else {
+			printf("Unknown argument '%s'\n", argv[k]);
+			return 2;
+		}
+	}
+
+	// every sceneNN_*.txt in the working directory, in order
+	vector<string> scenes;
+	for (const filesystem::directory_entry& entry : filesystem::directory_iterator(".")) {
+		string name = entry.path().filename().string();
+		if (name.size() > 9 && name.compare(0, 5, "scene") == 0 && name.compare(name.size() - 4, 4, ".txt") == 0) {
+			scenes.push_back(name.substr(0, name.size() - 4));
+		}
+	}
+	sort(scenes.begin(), scenes.end());
+	if (scenes.empty()) {
+		printf("No sceneNN_*.txt found, run from the directory holding the scenes\n");
+		return 2;
+	}
+	filesystem::create_directories(BENCH_OUT_DIR);
+	filesystem::create_directories(BENCH_REFERENCE_DIR);
+
+	FILE* out = fopen(output_filename.c_str(), "w");
+	if (out == NULL) {
+		printf("Cannot open %s\n", output_filename.c_str());
+		return 2;
+	}
+	string extra;
+	for (size_t k = 0; k < extra_args.size(); k++) { extra += (k ? " " : "") + extra_args[k]; }
+	fprintf(out, "{\n  \"size\": [%d, %d], \"bounces\": %s, \"repeat\": %d, \"threads\": %d, \"extra_args\": \"%s\",\n  \"scenes\": [",
+		width, height, BENCH_BOUNCES, repeat, num_threads, extra.c_str());
+
+	printf("%-22s %9s %9s %9s %9s %12s %9s %8s\n", "scene", "wall(s)", "render(s)", "filter(s)", "build(s)", "rays/s", "rss(MB)", "maxdiff");
+	int failures = 0;
+
+	for (size_t s = 0; s < scenes.size(); s++) {
+
+		string image = string(BENCH_OUT_DIR) + "/" + scenes[s] + ".bmp";
+		string reference = string(BENCH_REFERENCE_DIR) + "/" + scenes[s] + ".bmp";
+		string stats = string(BENCH_OUT_DIR) + "/" + scenes[s] + ".json";
+
+		vector<string> args = { renderer, "-input", scenes[s] + ".txt", "-size", to_string(width), to_string(height),
+			"-output", image, "-shadows", "-bounces", BENCH_BOUNCES, "-jitter", "-threads", to_string(num_threads),
+			"-stats-json", stats };
+		args.insert(args.end(), extra_args.begin(), extra_args.end());
+
+		// ------------------------- timed runs -------------------------
+		vector<double> wall, parse, build, render_time, filter, rays_per_second;
+		long peak_rss = 0;
+		bool ok = true;
+		for (int r = 0; r < repeat && ok; r++) {
+			Run run;
+			ok = render(args, run);
+			if (!ok) { break; }
+
+			ifstream file(stats);
+			stringstream text;
+			text << file.rdbuf();
+			string json = text.str();
+			run.parse = jsonNumber(json, "parse");
+			run.build = jsonNumber(json, "octree_build");
+			run.render = jsonNumber(json, "render");
+			run.filter = jsonNumber(json, "filter");
+			run.rays = (long long)(jsonNumber(json, "primary") + jsonNumber(json, "reflection")
+				+ jsonNumber(json, "refraction") + jsonNumber(json, "shadow"));
+
+			wall.push_back(run.wall);
+			parse.push_back(run.parse);
+			build.push_back(run.build);
+			render_time.push_back(run.render);
+			filter.push_back(run.filter);
+			// refinement samples are traced in the filter phase
+			rays_per_second.push_back(run.render + run.filter > 0 ? run.rays / (run.render + run.filter) : 0.);
+			peak_rss = max(peak_rss, run.peak_rss);
+		}
+		if (!ok) {
+			printf("%-22s failed to render\n", scenes[s].c_str());
+			fprintf(out, "%s\n    {\"scene\": \"%s\", \"error\": \"render failed\"}", s ? "," : "", scenes[s].c_str());
+			failures++;
+			continue;
+		}
+		// --------------------------------------------------------------
+
+		// ------------------------- regression check -------------------------
+		Image* result = Image::LoadBMP(image.c_str());
+		Image* expected = update ? NULL : Image::LoadBMP(reference.c_str());
+		int max_diff = -1; // -1: no reference to compare against
+		double mean_diff = 0.;
+		if (update && result != NULL) {
+			filesystem::copy_file(image, reference, filesystem::copy_options::overwrite_existing);
+			max_diff = 0;
+		}
+		else if (result != NULL && expected != NULL && result->Width() == expected->Width() && result->Height() == expected->Height()) {
+			Image* diff = Image::compare(result, expected);
+			max_diff = 0;
+			for (int y = 0; y < diff->Height(); y++) {
+				for (int x = 0; x < diff->Width(); x++) {
+					for (int c = 0; c < 3; c++) {
+						int levels = int(diff->GetPixel(x, y)[c] * 255.f + 0.5f);
+						max_diff = max(max_diff, levels);
+						mean_diff += levels;
+					}
+				}
+			}
+			mean_diff /= 3. * diff->Width() * diff->Height();
+			delete diff;
+		}
+		delete result;
+		delete expected;
+		bool pass = max_diff >= 0 && max_diff <= tolerance;
+		if (!pass) { failures++; }
+		// --------------------------------------------------------------------
+
+		printf("%-22s %9.3f %9.3f %9.3f %9.3f %12.0f %9.1f %8d %s\n", scenes[s].c_str(), median(wall), median(render_time), median(filter), median(build),
+			median(rays_per_second), peak_rss / 1024., max_diff, pass ? "ok" : max_diff < 0 ? "NO REFERENCE" : "DIFFERS");
+		fprintf(out, "%s\n    {\"scene\": \"%s\", \"wall\": %.6f, \"parse\": %.6f, \"octree_build\": %.6f, \"render\": %.6f, \"filter\": %.6f, "
+			"\"rays_per_second\": %.1f, \"peak_rss_kb\": %ld, \"max_diff\": %d, \"mean_diff\": %.6f, \"pass\": %s}",
+			s ? "," : "", scenes[s].c_str(), median(wall), median(parse), median(build), median(render_time), median(filter),
+			median(rays_per_second), peak_rss, max_diff, mean_diff, pass ? "true" : "false");
+	}
+
+	fprintf(out, "\n  ],\n  \"failures\": %d\n}\n", failures);
+	fclose(out);
+	printf("%d of %d scenes failed or differ from the reference, results in %s\n", failures, (int)scenes.size(), output_filename.c_str());
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// Microbenchmark for the ray/triangle kernels: the double precision
+// Cramer's rule test (Triangle::intersectBarycentric) against the
+// precomputed four-wide Moller-Trumbore packs (TrigPack), one ray against
+// four triangles and four rays (a RayPacket) against each triangle.
+//
+//   make trig_bench
+//   ./trig_bench [mesh.obj] [num_rays]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../Mesh.hpp"
+#include "../Random.h"
+#include "../RayPacket.h"
+
+using namespace std;
+
+int main( int argc, char* argv[] )
+{
+	const char* filename = argc > 1 ? argv[1] : "bunny_1k.obj";
+	int num_rays = argc > 2 ? atoi(argv[2]) : 2000;
+
+	Mesh mesh(filename, NULL);
+	if (mesh.t.empty()) { return 1; }
+	int num_trigs = mesh.t.size();
+
+	// rays from a sphere around the mesh towards random points inside its box
+	Box box;
+	mesh.getBoundingBox(box);
+	Vector3f center = box.center();
+	float radius = (box.mx - box.mn).abs();
+	vector<Ray> rays;
+	PixelRandom rng(1, 2);
+	for (int k = 0; k < num_rays; k++) {
+		Vector3f dir(rng.uniform() - 0.5f, rng.uniform() - 0.5f, rng.uniform() - 0.5f);
+		Vector3f origin = center + radius * dir.normalized();
+		Vector3f target(box.mn[0] + rng.uniform() * (box.mx[0] - box.mn[0]),
+			box.mn[1] + rng.uniform() * (box.mx[1] - box.mn[1]),
+			box.mn[2] + rng.uniform() * (box.mx[2] - box.mn[2]));
+		rays.push_back(Ray(origin, (target - origin).normalized()));
+	}
+
+	// packs over the whole mesh, no octree, so only the kernel is measured
+	vector<TrigPack> packs((num_trigs + 3) / 4);
+	for (int k = 0; k < num_trigs; k++) {
+		packs[k / 4].set(k % 4, k, mesh.v[mesh.t[k][0]], mesh.v[mesh.t[k][1]], mesh.v[mesh.t[k][2]]);
+	}
+
+	// ------------------------- Cramer's rule -------------------------
+	vector<int> nearest_old(num_rays, -1);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int r = 0; r < num_rays; r++) {
+		double tmax = FLT_MAX;
+		for (int k = 0; k < num_trigs; k++) {
+			double alpha, beta, gamma, t;
+			if (Triangle::intersectBarycentric(mesh.v[mesh.t[k][0]], mesh.v[mesh.t[k][1]], mesh.v[mesh.t[k][2]],
+				rays[r], alpha, beta, gamma, t) && t > 0 && t < tmax) {
+				tmax = t;
+				nearest_old[r] = k;
+			}
+		}
+	}
+	double old_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	// -----------------------------------------------------------------
+
+	// ------------------------- SoA packs -------------------------
+	vector<int> nearest_new(num_rays, -1);
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < num_rays; r++) {
+		float tmax = FLT_MAX;
+		float t[4], u[4], v[4];
+		for (size_t p = 0; p < packs.size(); p++) {
+			int mask = packs[p].intersect(rays[r].getOrigin(), rays[r].getDirection(), 0, tmax, t, u, v);
+			for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+				if ((mask & 1) && t[lane] < tmax) {
+					tmax = t[lane];
+					nearest_new[r] = packs[p].id[lane];
+				}
+			}
+		}
+	}
+	double new_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	// -------------------------------------------------------------
+
+	// ------------------------- 4 rays x 4 triangles -------------------------
+	vector<int> nearest_packet(num_rays, -1);
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < num_rays; r += PACKET_SIZE) {
+		const Ray* lanes[PACKET_SIZE];
+		int count = min(PACKET_SIZE, num_rays - r);
+		for (int lane = 0; lane < count; lane++) { lanes[lane] = &rays[r + lane]; }
+		RayPacket packet(lanes, count);
+		float tmax[PACKET_SIZE] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+		float t[4], u[4], v[4];
+		for (size_t p = 0; p < packs.size(); p++) {
+			for (int k = 0; k < 4 && packs[p].id[k] >= 0; k++) {
+				int mask = packs[p].intersectRays(k, packet.o, packet.d, 0, tmax, t, u, v) & packet.mask;
+				for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+					if (mask & 1) {
+						tmax[lane] = t[lane];
+						nearest_packet[r + lane] = packs[p].id[k];
+					}
+				}
+			}
+		}
+	}
+	double packet_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	// ------------------------------------------------------------------------
+
+	int agree = 0, agree_packet = 0;
+	for (int r = 0; r < num_rays; r++) {
+		if (nearest_old[r] == nearest_new[r]) { agree++; }
+		if (nearest_packet[r] == nearest_new[r]) { agree_packet++; }
+	}
+
+	double tests = double(num_rays) * num_trigs;
+	printf("%s: %d triangles, %d rays\n", filename, num_trigs, num_rays);
+	printf("cramer   %8.2f Mtris/s\n", tests / old_sec * 1e-6);
+	printf("trigpack %8.2f Mtris/s (%.1fx)\n", tests / new_sec * 1e-6, old_sec / new_sec);
+	printf("packet4  %8.2f Mtris/s (%.1fx)\n", tests / packet_sec * 1e-6, old_sec / packet_sec);
+	printf("nearest triangle agrees on %d of %d rays\n", agree, num_rays);
+	printf("packet4 nearest triangle matches trigpack on %d of %d rays\n", agree_packet, num_rays);
+	return 0;
+}
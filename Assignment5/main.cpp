@@ -5,15 +5,28 @@
 #include <cmath>
 #include <cfloat>
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <chrono>
 
 #include "SceneParser.h"
 #include "Image.h"
 #include "Camera.h"
 #include <string.h>
 #include "RayTracer.h"
+#include "Sampler.h"
+#include "TileScheduler.h"
+#include "AOV.h"
+#include "Stats.h"
 
 using namespace std;
 
+// adaptive supersampling (-jitter)
+#define AA_CONTRAST 0.1f // neighbour colour difference that triggers refinement
+#define AA_VARIANCE 0.0025f // sample variance that asks for the next level of strata
+#define AA_MAX_STRATA 4 // default -aa-max-strata: at most 4x4 extra samples a level
+#define AA_SIGMA 0.5f // width of the Gaussian reconstruction filter in pixels
+
 
 #include "bitmap_image.hpp"
 int main( int argc, char* argv[] )
@@ -21,7 +34,7 @@ int main( int argc, char* argv[] )
 	// Report help usage if no args specified.
 	if (argc == 1) {
 		cout << "Usage: a4 "
-			<< "-input <scene> -size <width> <height> -output <image.png> -depth <depth_min> <depth_max> <depth_image.png> [-normals <normals_image.png>]\n";
+			<< "-input <scene> -size <width> <height> -output <image.png> -depth <depth_min> <depth_max> <depth_image.png> [-normal <normals_image.png>] [-albedo <albedo_image.png>] [-objectid <id_image.png>] [-hitcount <hits_image.png>] [-shadows] [-bounces <n>] [-prune <threshold>] [-light-samples <n>] [-jitter] [-sampler <stratified|halton|sobol>] [-aa-max-strata <n>] [-wavefront] [-packets] [-threads <n>] [-stats] [-stats-json <stats.json>] [-stats-skipped] [-compile-scene <scene.bin>]\n";
 		return 1;
 	}
 
@@ -30,20 +43,51 @@ int main( int argc, char* argv[] )
 	char* output_filename;
 	char* depth_filename;
 	char* normal_filename;
+	char* albedo_filename;
+	char* id_filename;
+	char* hits_filename;
 	int width, height;
 	float depth_min, depth_max;
 	bool depth_toggle, normal_toggle; // for depth and normal vis
+	bool albedo_toggle, id_toggle, hits_toggle; // for albedo, object ID and hit count vis
 	bool jitter, filter;
+	const char* sampler_name;
+	int max_strata;
 	int max_bounces;
+	float prune_threshold;
+	int light_samples;
 	bool shadow_toggle;
+	int num_threads;
+	int build_threads; // octree build, every hardware thread unless -threads is given
+	bool stats;
+	char* stats_filename;
+	bool wavefront;
+	bool packets;
+	char* compile_filename;
 
 	// init parameters
 	width = 0; height = 0;
 	depth_min = 0.; depth_max = 0.;
 	depth_toggle = false; normal_toggle = false;
+	albedo_toggle = false; id_toggle = false; hits_toggle = false;
 	jitter = false; 
+	sampler_name = "stratified";
+	max_strata = AA_MAX_STRATA;
 	max_bounces = 0;
+	prune_threshold = 0.f;
+	light_samples = 0;
 	shadow_toggle = false;
+	num_threads = 1;
+	build_threads = 0;
+	stats = false;
+	stats_filename = NULL;
+	wavefront = false;
+	packets = false;
+	output_filename = NULL;
+	scene_filename = NULL;
+	depth_filename = NULL; normal_filename = NULL;
+	albedo_filename = NULL; id_filename = NULL; hits_filename = NULL;
+	compile_filename = NULL;
 
 	// This loop loops over each of the input arguments.
 	for (int argNum = 1; argNum < argc; ++argNum) {
@@ -74,172 +118,310 @@ int main( int argc, char* argv[] )
 			normal_toggle = true;
 			normal_filename = argv[argNum + 1];
 		}
+		if (strcmp(argv[argNum], "-albedo") == 0) {
+			albedo_toggle = true;
+			albedo_filename = argv[argNum + 1];
+		}
+		if (strcmp(argv[argNum], "-objectid") == 0) {
+			id_toggle = true;
+			id_filename = argv[argNum + 1];
+		}
+		if (strcmp(argv[argNum], "-hitcount") == 0) {
+			hits_toggle = true;
+			hits_filename = argv[argNum + 1];
+		}
 		if (strcmp(argv[argNum], "-shadows") == 0) {
 			shadow_toggle = true;
 		}
 		if (strcmp(argv[argNum], "-bounces") == 0) {
 			max_bounces = atoi(argv[argNum + 1]);
 		}
+		if (strcmp(argv[argNum], "-prune") == 0) {
+			prune_threshold = atof(argv[argNum + 1]); // skip secondary rays weighing less than this
+		}
+		if (strcmp(argv[argNum], "-light-samples") == 0) {
+			light_samples = atoi(argv[argNum + 1]); // point lights picked per hit, 0 uses all of them
+		}
 		if (strcmp(argv[argNum], "-jitter") == 0) {
 			jitter = true;
 		}
+		if (strcmp(argv[argNum], "-sampler") == 0) {
+			sampler_name = argv[argNum + 1]; // stratified, halton or sobol
+		}
+		if (strcmp(argv[argNum], "-aa-max-strata") == 0) {
+			max_strata = atoi(argv[argNum + 1]); // finest level of -jitter samples per axis
+		}
+		if (strcmp(argv[argNum], "-threads") == 0) {
+			num_threads = atoi(argv[argNum + 1]); // 0 uses every hardware thread
+			build_threads = num_threads;
+		}
+		if (strcmp(argv[argNum], "-wavefront") == 0) {
+			wavefront = true; // trace each tile in stages instead of recursively
+		}
+		if (strcmp(argv[argNum], "-packets") == 0) {
+			packets = true; // trace 2x2 pixel blocks as ray packets
+		}
+		if (strcmp(argv[argNum], "-stats") == 0) {
+			stats = true;
+		}
+		if (strcmp(argv[argNum], "-stats-json") == 0) {
+			stats = true;
+			stats_filename = argv[argNum + 1];
+		}
+		if (strcmp(argv[argNum], "-compile-scene") == 0) {
+			compile_filename = argv[argNum + 1]; // render later with -input <scene.bin>
+		}
+		if (strcmp(argv[argNum], "-stats-skipped") == 0) {
+			stats = true;
+			Stats::skipped = true; // counting skipped octree cells costs a full traversal
+		}
 	}
 	
-	// declaring variables for scene rendering
-	Light* light;
-	Hit hit;
-	Vector2f coordinate;
-	Vector3f pix_col;
-	Vector3f light_dir, light_col, shading_col;
-	float light_dist;
+	Stats::enabled = stats;
+
+	if (scene_filename == NULL) {
+		cout << "No scene given, use -input <scene.txt>" << endl;
+		return 1;
+	}
+
+	Sampler* probe = Sampler::create(sampler_name);
+	if (probe == NULL) {
+		cout << "Unknown sampler '" << sampler_name << "', use stratified, halton or sobol" << endl;
+		return 1;
+	}
+	delete probe;
 
 	// init classes
-	SceneParser scene(scene_filename); // First, parse the scene using SceneParser.
+	auto parse_start = std::chrono::steady_clock::now();
+	SceneParser scene(scene_filename, build_threads); // First, parse the scene using SceneParser.
+	Stats::addTime(Stats::PARSE, std::chrono::duration<double>(std::chrono::steady_clock::now() - parse_start).count());
+	if (compile_filename != NULL) {
+		if (!scene.compile(compile_filename)) { return 1; }
+		cout << "compiled scene written to " << compile_filename << endl;
+		if (output_filename == NULL) { return 0; } // compile only
+	}
 	Image img(width, height); // init image
-	Image img_depth(width, height); // init depth image 
-	Image img_normals(width, height); // init normal image 
-	RayTracer ray_tracer = RayTracer::RayTracer(&scene, max_bounces, shadow_toggle);
+	AOVBuffers aovs(width, height); // init depth, normal, albedo, object ID and hit count images
+	RayTracer ray_tracer(&scene, max_bounces, shadow_toggle, prune_threshold, light_samples);
 
 	img.SetAllPixels( scene.getBackgroundColor(Vector3f::ZERO) ); // init scene pixels
-	img_depth.SetAllPixels( Vector3f::ZERO ); // init depth scene pixels
-	img_normals.SetAllPixels( Vector3f::ZERO ); // init normal scene pixels
+	if (depth_toggle) { aovs.enable(AOVBuffers::DEPTH, depth_filename); aovs.setDepthRange(depth_min, depth_max); }
+	if (normal_toggle) { aovs.enable(AOVBuffers::NORMAL, normal_filename); }
+	if (albedo_toggle) { aovs.enable(AOVBuffers::ALBEDO, albedo_filename); }
+	if (id_toggle) { aovs.enable(AOVBuffers::OBJECT_ID, id_filename); }
+	if (hits_toggle) { aovs.enable(AOVBuffers::HIT_COUNT, hits_filename); }
+	bool aov_toggle = aovs.any();
+	int aov_fields = aovs.fields(); // -jitter alone only needs the object IDs
 
-	// init for supersampling (jitter and Gaussian blurring)
-	int ss_width = width * 3, ss_height = height * 3; // supersampling heights and widths
-	Image ss_img = Image(width * 3, height * 3);
-	ss_img.SetAllPixels(scene.getBackgroundColor(Vector3f::ZERO));
+	// init for adaptive supersampling: the first pass traces every pixel
+	// centre, the second one adds stratified samples only where a pixel
+	// differs from its neighbours, so memory stays at output size
+	std::vector<int> pix_id(jitter ? width * height : 0); // primary hit object per pixel
+	std::vector<unsigned char> refine(jitter ? width * height : 0); // pixels that get more samples
+	std::atomic<long long> num_samples(width * height);
 
-	if (jitter) {
-		width = ss_width;
-		height = ss_height;
-	}
+	// camera ray through the (sub-)pixel position (x, y)
+	auto cameraRay = [&](float x, float y) {
+		Vector2f coordinate(2. * x / (float(width) - 1.) - 1.,
+			2. * y / (float(height) - 1.) - 1.); // mapping coordinates to scene pixel-grid
+		Vector2f pixel(2. / (float(width) - 1.), 2. / (float(height) - 1.)); // one pixel step
+		return scene.getCamera()->generateRay(coordinate, pixel);
+	};
+
+	// traces one ray through the (sub-)pixel position (x, y)
+	auto tracePixel = [&](float x, float y, AOVSample* sample) {
+		Hit hit(FLT_MAX, NULL, Vector3f::ZERO); // init hit variable
+		Ray ray = cameraRay(x, y); // init ray for ray casting
+		return ray_tracer.traceRay(ray, scene.getCamera()->getTMin(), max_bounces, 1.f, hit, sample);
+	};
+
+	// same as renderTile, but traces 2x2 blocks of pixels as ray packets
+	auto renderTilePackets = [&](const Tile& tile, int /*thread_id*/) {
+
+		// declaring variables for scene rendering
+		Vector3f colors[PACKET_SIZE];
+		AOVSample samples[PACKET_SIZE];
+		for (int k = 0; k < PACKET_SIZE; k++) { samples[k] = AOVSample(aov_fields); }
+
+		for (int i = tile.x0; i < tile.x1; i += 2) {
+			for (int j = tile.y0; j < tile.y1; j += 2) {
+
+				// the block's pixels inside the tile
+				int pi[PACKET_SIZE], pj[PACKET_SIZE], count = 0;
+				for (int k = 0; k < PACKET_SIZE; k++) {
+					if (i + k / 2 < tile.x1 && j + k % 2 < tile.y1) {
+						pi[count] = i + k / 2; pj[count] = j + k % 2; count++;
+					}
+				}
+				Ray r0 = cameraRay(float(pi[0]), float(pj[0]));
+				Ray r1 = count > 1 ? cameraRay(float(pi[1]), float(pj[1])) : r0;
+				Ray r2 = count > 2 ? cameraRay(float(pi[2]), float(pj[2])) : r0;
+				Ray r3 = count > 3 ? cameraRay(float(pi[3]), float(pj[3])) : r0;
+				const Ray* rays[PACKET_SIZE] = { &r0, &r1, &r2, &r3 };
+
+				for (int k = 0; k < count; k++) { samples[k].reset(); }
+				ray_tracer.tracePacket(rays, count, scene.getCamera()->getTMin(), colors, (aov_toggle || jitter) ? samples : NULL);
+
+				for (int k = 0; k < count; k++) {
+					img.SetPixel(pj[k], pi[k], colors[k]); // setting pixels to color 
+					if (aov_toggle) { aovs.store(pj[k], pi[k], samples[k]); }
+					if (jitter) { pix_id[pj[k] * width + pi[k]] = samples[k].objectId; }
+				}
+			}
+		}
+	};
 
-	// loops over scene view width and height
-	for (unsigned i = 0; i < width; i++) {
-		for (unsigned j = 0; j < height; j++) {
+	// same as renderTile, but traces the whole tile as one wavefront
+	auto renderTileWavefront = [&](const Tile& tile, int /*thread_id*/) {
 
-			if (jitter) { // checking jitter toggle
-				float jit = -0.5 + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / (0.5 - (-0.5)))); // jitter perturbation
-				float ii = i + jit, jj = j + jit; // updating ray casting points with jitter
-				coordinate = Vector2f(2. * float(ii) / (float(width) - 1.) - 1.,
-					2. * float(jj) / (float(height) - 1.) - 1.); // mapping coordinates to scene pixel-grid
+		// declaring variables for scene rendering
+		std::vector<Ray> rays;
+		std::vector<Vector3f> colors;
+		std::vector<AOVSample> samples((tile.x1 - tile.x0) * (tile.y1 - tile.y0), AOVSample(aov_fields));
+
+		for (int i = tile.x0; i < tile.x1; i++) {
+			for (int j = tile.y0; j < tile.y1; j++) {
+				rays.push_back(cameraRay(float(i), float(j)));
 			}
-			else {
-				coordinate = Vector2f(2. * float(i) / (float(width) - 1.) - 1.,
-					2. * float(j) / (float(height) - 1.) - 1.); // mapping coordinates to scene pixel-grid
+		}
+
+		ray_tracer.traceWavefront(rays, scene.getCamera()->getTMin(), colors, (aov_toggle || jitter) ? &samples[0] : NULL);
+
+		int k = 0;
+		for (int i = tile.x0; i < tile.x1; i++) {
+			for (int j = tile.y0; j < tile.y1; j++, k++) {
+				img.SetPixel(j, i, colors[k]); // setting pixels to color 
+				if (aov_toggle) { aovs.store(j, i, samples[k]); }
+				if (jitter) { pix_id[j * width + i] = samples[k].objectId; }
 			}
-			
-			hit = Hit(FLT_MAX, NULL, Vector3f::ZERO); // init hit variable
-			Ray ray = scene.getCamera()->generateRay(coordinate); // init ray for ray casting
+		}
+	};
 
-			// ------------------------- performing ray tracing -------------------------
-			pix_col = ray_tracer.traceRay(ray, scene.getCamera()->getTMin(), max_bounces, 1.f, hit);
-			if (jitter) { ss_img.SetPixel(j, i, pix_col); } // setting jitter pixels to color 
-			else { img.SetPixel(j, i, pix_col); } // setting unjittered pixels to color 
-			// --------------------------------------------------------------------------
+	// renders every pixel of one tile; tiles are independent, so the
+	// scheduler may hand them to any thread in any order
+	auto renderTile = [&](const Tile& tile, int /*thread_id*/) {
 
-			if (scene.getGroup()->intersect(ray, hit, scene.getCamera()->getTMin())) {
+		// declaring variables for scene rendering
+		Vector3f pix_col;
+		AOVSample sample(aov_fields);
 
-				// ------------------------- getting depth image -------------------------
-				if (depth_toggle) {
+		// loops over the tile's share of the scene view width and height
+		for (int i = tile.x0; i < tile.x1; i++) {
+			for (int j = tile.y0; j < tile.y1; j++) {
 
-					if (hit.getT() < depth_min) {
-						img_depth.SetPixel(j, i, Vector3f(1., 1., 1.));
-					}
-					else if (hit.getT() > depth_max) {
-						img_depth.SetPixel(j, i, Vector3f::ZERO);
-					}
-					else {
-						float depths = (depth_max - hit.getT()) / (depth_max - depth_min);
-						img_depth.SetPixel(j, i, depths * Vector3f(1., 1., 1.));
-					}
-				}
-				// -----------------------------------------------------------------------
+				sample.reset();
+
+				// ------------------------- performing ray tracing -------------------------
+				// one trace fills the colour and every output variable
+				pix_col = tracePixel(float(i), float(j), (aov_toggle || jitter) ? &sample : NULL);
+				img.SetPixel(j, i, pix_col); // setting pixels to color 
+				// --------------------------------------------------------------------------
+
+				if (aov_toggle) { aovs.store(j, i, sample); }
+				if (jitter) { pix_id[j * width + i] = sample.objectId; }
+			}
+		}
+	};
+
+	// supersamples the flagged pixels of one tile; each pixel only reads
+	// and writes itself, the Gaussian filter is applied while accumulating
+	auto refineTile = [&](const Tile& tile, int /*thread_id*/) {
 
-				// ------------------------- getting normal image -------------------------
-				if (normal_toggle) {
+		// declaring variables for supersampling
+		Vector3f col, sum, mean, mean_sq;
+		float dx, dy, w, w_sum, var;
+		int count = 0;
+		Sampler* sampler = Sampler::create(sampler_name);
+		std::vector<Vector2f> points(max_strata * max_strata);
 
-					// declaring color variable
-					Vector3f col_norm;
+		for (int i = tile.x0; i < tile.x1; i++) {
+			for (int j = tile.y0; j < tile.y1; j++) {
 
-					// getting coloring as normal vector
-					col_norm = hit.getNormal();
-					col_norm.normalized();
+				if (!refine[j * width + i]) { continue; }
 
-					// ensuring positive definite entries
+				sampler->startPixel(i, j); // seeded per pixel, independent of thread count
+				sum = img.GetPixel(j, i); w_sum = 1.f; // the centre sample
+
+				// 2x2 samples first, 4x4 more only while the samples disagree
+				for (int strata = 2; strata <= max_strata; strata *= 2) {
+					mean = Vector3f::ZERO; mean_sq = Vector3f::ZERO;
+					sampler->next2D(strata * strata, 0, &points[0]);
+					for (int k = 0; k < strata * strata; k++) {
+						dx = points[k][0] - 0.5f; // offset from the pixel centre
+						dy = points[k][1] - 0.5f;
+						col = tracePixel(i + dx, j + dy, NULL);
+						w = exp(-(dx * dx + dy * dy) / (2.f * AA_SIGMA * AA_SIGMA));
+						sum += w * col; w_sum += w;
+						mean += col; mean_sq += col * col;
+					}
+					count += strata * strata;
+
+					// largest per-channel variance of this level's samples
+					mean = mean / float(strata * strata); mean_sq = mean_sq / float(strata * strata);
+					var = 0.f;
 					for (int k = 0; k < 3; k++) {
-						col_norm[k] = pow(-1., (col_norm[k] < 0.)) * col_norm[k];
+						var = max(var, mean_sq[k] - mean[k] * mean[k]);
 					}
-					img_normals.SetPixel(j, i, col_norm);
+					if (var < AA_VARIANCE) { break; }
 				}
-				// ------------------------------------------------------------------------
+				img.SetPixel(j, i, sum / w_sum);
 			}
 		}
-	}
+		num_samples += count;
+		delete sampler;
+	};
+
+	// ------------------------- tile-parallel rendering -------------------------
+	auto render_start = std::chrono::steady_clock::now();
+	TileScheduler scheduler(width, height, 16, num_threads);
+	if (wavefront) { scheduler.run(renderTileWavefront); }
+	else if (packets) { scheduler.run(renderTilePackets); }
+	else { scheduler.run(renderTile); }
+	// ---------------------------------------------------------------------------
+	Stats::addTime(Stats::RENDER, std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count());
 
 	if (jitter) {
-		// ------------------------------------ Gaussian blurring ------------------------------------
-		// declare variables
-		int n;
-		Vector3f pixel;
+		Stats::Timer filter_timer(Stats::FILTER);
 
-		// Gaussian convolutional kernel values
-		float kernel[5] = { 0.1201, 0.2339, 0.2931, 0.2339, 0.1201 }; 
-		
-		// horizontal Gaussian blurring
-		Image blur_img1 = Image(ss_width, ss_height);
-		blur_img1.SetAllPixels(scene.getBackgroundColor(Vector3f::ZERO));
-		
-		for (int i = 0; i < ss_width; i++) {
-			for (int j = 0; j < ss_height; j++) {
-
-				pixel = Vector3f::ZERO; // reinit pixel value
-				// loop over kernel values
-				for (int k = 0; k < 5; k++) {
-					int n = i - 2 + k;
-					if (n < 0) { n = 0; }
-					if (n >= ss_width) { n = ss_width - 1; }
-					pixel += kernel[k] * ss_img.GetPixel(j, n);
-				}
-				blur_img1.SetPixel(j, i, pixel);
-			}
-		}
-		// vertical Gaussian blurring
-		Image blur_img2 = Image(ss_width, ss_height);
-		blur_img2.SetAllPixels(scene.getBackgroundColor(Vector3f::ZERO));
-		for (int i = 0; i < ss_width; i++) {
-			for (int j = 0; j < ss_height; j++) {
-				
-				pixel = Vector3f::ZERO; // reinit pixel value
-				// loop over kernel values
-				for (int k = 0; k < 5; k++) {
-					int n = j - 2 + k;
-					if (n < 0) { n = 0; }
-					if (n >= ss_height) { n = ss_height - 1; }
-					pixel += kernel[k] * blur_img1.GetPixel(n, i);
+		// ------------------------- flagging edges -------------------------
+		// a pixel is refined when a 4-neighbour hit another object or its
+		// colour differs by more than AA_CONTRAST in any channel
+		for (int i = 0; i < width; i++) {
+			for (int j = 0; j < height; j++) {
+
+				const Vector3f& c = img.GetPixel(j, i);
+				int id = pix_id[j * width + i];
+				int ni[4] = { i - 1, i + 1, i, i }, nj[4] = { j, j, j - 1, j + 1 };
+				for (int k = 0; k < 4; k++) {
+					if (ni[k] < 0 || ni[k] >= width || nj[k] < 0 || nj[k] >= height) { continue; }
+					Vector3f diff = img.GetPixel(nj[k], ni[k]) - c;
+					if (pix_id[nj[k] * width + ni[k]] != id || max(fabs(diff[0]), max(fabs(diff[1]), fabs(diff[2]))) > AA_CONTRAST) {
+						refine[j * width + i] = 1;
+						break;
+					}
 				}
-				blur_img2.SetPixel(j, i, pixel);
 			}
 		}
-		// -------------------------------------------------------------------------------------------
+		// ------------------------------------------------------------------
 
-		// ------------------------------------ downsampling ------------------------------------
-		for (int i = 0; i < int(width / 3); i++) {
-			for (int j = 0; j < int(height / 3); j++) {
-				pixel = blur_img2.GetPixel(3 * j + 0, 3 * i + 0) + blur_img2.GetPixel(3 * j + 0, 3 * i + 1) + blur_img2.GetPixel(3 * j + 0, 3 * i + 2) +
-						blur_img2.GetPixel(3 * j + 1, 3 * i + 0) + blur_img2.GetPixel(3 * j + 1, 3 * i + 1) + blur_img2.GetPixel(3 * j + 1, 3 * i + 2) +
-						blur_img2.GetPixel(3 * j + 2, 3 * i + 0) + blur_img2.GetPixel(3 * j + 2, 3 * i + 1) + blur_img2.GetPixel(3 * j + 2, 3 * i + 2);
-				pixel = pixel / 9.f;
-				img.SetPixel(j, i, pixel);
-			}
-		}
-		// -------------------------------------------------------------------------------------
+		scheduler.run(refineTile); // few scattered pixels, traced recursively
 	}
+	double render_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_start).count();
 
+	{
+		Stats::Timer save_timer(Stats::SAVE);
+		img.SaveBMP(output_filename);
+		aovs.save();
+	}
 
-	img.SaveBMP(output_filename);
-	if (depth_toggle) { img_depth.SaveBMP(depth_filename); }
-	if (normal_toggle) { img_normals.SaveBMP(normal_filename); }
+	if (stats) {
+		ThreadStats total = Stats::total();
+		Stats::print();
+		cout << "camera samples: " << num_samples << " (" << float(num_samples) / float(width * height) << " per pixel)" << endl;
+		cout << (wavefront ? "wavefront" : packets ? "packet" : "recursive") << " render " << render_time << " s, "
+			<< (total.rays + total.shadow) / render_time << " rays/s" << endl;
+		if (stats_filename != NULL) { Stats::saveJSON(stats_filename); }
+	}
 
 	
 	return 0;
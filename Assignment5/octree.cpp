@@ -5,6 +5,43 @@
 #include "octree.hpp"
 #include <vector>
 #include <algorithm>
+#include <iostream>
+#include <atomic>
+#include <thread>
+
+//packet leaves with at least this many lanes test each triangle against
+//the lanes together, fewer lanes are traced one ray at a time
+#define PACKET_LEAF_LANES 3
+
+//nodes that still need splitting at this level are built as parallel
+//tasks, up to 8^OCTREE_TASK_LEVEL of them
+#define OCTREE_TASK_LEVEL 2
+
+void OctreeQuery::addStats() const
+{
+#ifdef RT_STATS
+	if(Stats::enabled){
+		ThreadStats & s = Stats::local();
+		s.nodesVisited += nodesVisited;
+		s.leavesVisited += leavesVisited;
+		s.leavesSkipped += leavesSkipped;
+		s.trigTests += trigsTested;
+		s.trigsSkipped += trigsSkipped;
+	}
+#endif
+}
+
+void OctreePacketQuery::addStats() const
+{
+#ifdef RT_STATS
+	if(Stats::enabled){
+		ThreadStats & s = Stats::local();
+		s.nodesVisited += nodesVisited;
+		s.leavesVisited += leavesVisited;
+		s.trigTests += trigsTested;
+	}
+#endif
+}
 
  
 ///@brief two intervals intersect
@@ -59,26 +96,13 @@ Box trigBox(int t, const Mesh & m ){
 	return b;
 }
 
-///@brief pbox parent's box
-void Octree::buildNode(OctNode  & parent, const Box & pbox ,
-	const std::vector<int>&trigs, 
-	const Mesh & m, int level)
+///@brief splits pbox at its center, child index bits are 4: upper x,
+///2: upper y, 1: upper z
+static void childBoxes(const Box & pbox, Box cBox[8])
 {
-	if(trigs.size() <= Octree :: max_trig
-		|| level>maxLevel){
-		parent.obj = trigs;
-		return;
-	}
-	level++;
-	//initialize 8 children
-	for(int ii = 0; ii<8;ii++){
-		parent.child[ii]=new OctNode();
-	}
 	const Vector3f & mn = pbox.mn;
 	const Vector3f & mx = pbox.mx;
 	Vector3f mid = (mn + mx)/2;
-	//childBox;
-	Box cBox[8];
 	//ewww....
 	cBox[0] = Box(mn,mid);
 	cBox[1] = Box(mn[0], mn[1],  mid[2], mid[0], mid[1], mx[2] );
@@ -88,29 +112,147 @@ void Octree::buildNode(OctNode  & parent, const Box & pbox ,
 	cBox[5] = Box(mid[0], mn[1],  mid[2], mx[0],  mid[1], mx[2] );
 	cBox[6] = Box(mid[0], mid[1], mn[2],  mx[0],  mx[1],  mid[2] );
 	cBox[7] = Box(mid[0], mid[1], mid[2], mx[0],  mx[1],  mx[2] );
-	//std::vector<bool>added (trigs.size(),false);
+}
+
+///@brief builds one subtree into its own node and pack arrays, so that
+///several can be built at once. Triangle lists live on one scratch stack:
+///a node's list is a range of it, its children's lists are pushed above.
+struct OctreeBuilder
+{
+	OctreeBuilder(const Octree & tree, const Mesh & m, const std::vector<Box> & trigBoxes, int taskLevel):
+	tree(tree),m(m),trigBoxes(trigBoxes),taskLevel(taskLevel){
+	}
+	const Octree & tree;
+	const Mesh & m;
+	///@brief bounding box of every triangle, computed once
+	const std::vector<Box> & trigBoxes;
+	///@brief nodes at this level that need splitting become tasks
+	///instead, -1 to build everything here
+	int taskLevel;
+
+	std::vector<OctNode> nodes;
+	///@brief leaves' triangles; until Octree::build packs them, a leaf's
+	///packStart is the index of its first triangle here
+	std::vector<int> leafTrigs;
+	std::vector<int> stack;
+
+	///@brief subtree left for a parallel builder
+	struct Task
+	{
+		int node;
+		Box box;
+		std::vector<int> trigs;
+		int level;
+	};
+	std::vector<Task> tasks;
+
+	void buildNode(int idx, const Box & pbox, int begin, int end, int level);
+	void makeLeaf(int idx, int begin, int end);
+	///@brief copies a finished task's subtree in place of its node
+	void splice(const Task & task, const OctreeBuilder & sub);
+};
+
+///@brief closed interval overlap, as boxOverlap on one axis
+static inline bool overlap(float amn, float amx, float bmn, float bmx)
+{
+	return amn <= bmx && bmn <= amx;
+}
+
+///@brief pbox parent's box, its triangles are stack[begin, end)
+void OctreeBuilder::buildNode(int idx, const Box & pbox, int begin, int end, int level)
+{
+	if(end - begin <= tree.maxTrig
+		|| level>tree.maxLevel){
+		makeLeaf(idx, begin, end);
+		return;
+	}
+	if(level == taskLevel){
+		Task task;
+		task.node = idx;
+		task.box = pbox;
+		task.trigs.assign(stack.begin() + begin, stack.begin() + end);
+		task.level = level;
+		tasks.push_back(task);
+		return;
+	}
+	level++;
+	//the 8 children are stored together
+	int first = nodes.size();
+	nodes[idx].child = first;
+	nodes.resize(first + 8);
+	//childBox;
+	Box cBox[8];
+	childBoxes(pbox, cBox);
 	for(int ii = 0 ; ii<8;ii++){
-		std::vector<int> childTrigs;
-		for(unsigned int vi =0; vi<trigs.size();vi++){
-			int trigIdx = trigs[vi];
-			Box tBox = trigBox(trigIdx, m);
-			if(inside(tBox, cBox[ii])
-				||boxOverlap(&tBox, &(cBox[ii]))
-				){
-				childTrigs.push_back(trigIdx);
-		//		added[vi]=true;
+		//a triangle goes to every child its box touches
+		int childBegin = stack.size();
+		for(int vi = begin; vi<end; vi++){
+			const Box & tBox = trigBoxes[stack[vi]];
+			if(overlap(tBox.mn[0], tBox.mx[0], cBox[ii].mn[0], cBox[ii].mx[0])
+				&& overlap(tBox.mn[1], tBox.mx[1], cBox[ii].mn[1], cBox[ii].mx[1])
+				&& overlap(tBox.mn[2], tBox.mx[2], cBox[ii].mn[2], cBox[ii].mx[2])){
+				stack.push_back(stack[vi]);
 			}
 		}
-		buildNode(*(parent.child[ii]),cBox[ii], childTrigs,m,level);
+		buildNode(first + ii, cBox[ii], childBegin, stack.size(), level);
+		stack.resize(childBegin);
+	}
+}
+
+void OctreeBuilder::makeLeaf(int idx, int begin, int end)
+{
+	OctNode & node = nodes[idx];
+	node.trigCount = end - begin;
+	node.packStart = leafTrigs.size();
+	leafTrigs.insert(leafTrigs.end(), stack.begin() + begin, stack.begin() + end);
+}
+
+void OctreeBuilder::splice(const Task & task, const OctreeBuilder & sub)
+{
+	//sub's root replaces the task's node, the rest is appended
+	uint32_t nodeBase = nodes.size() - 1;
+	int trigBase = leafTrigs.size();
+	for(unsigned int ii = 0; ii<sub.nodes.size(); ii++){
+		OctNode node = sub.nodes[ii];
+		if(!node.isTerm()){
+			node.child += nodeBase;
+		}
+		node.packStart += trigBase;
+		if(ii == 0){
+			nodes[task.node] = node;
+		}else{
+			nodes.push_back(node);
+		}
+	}
+	leafTrigs.insert(leafTrigs.end(), sub.leafTrigs.begin(), sub.leafTrigs.end());
+}
+
+///@brief calls func(k) for k in [0, count) on numThreads threads, all
+///hardware threads if numThreads is 0
+template<typename Func>
+static void parallelFor(int count, int numThreads, const Func & func)
+{
+	std::atomic<int> next(0);
+	auto worker = [&](){
+		for(int k = next++; k < count; k = next++){
+			func(k);
+		}
+	};
+	if(numThreads <= 0){
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	numThreads = std::min(count, numThreads);
+	std::vector<std::thread> threads;
+	for(int t = 1; t<numThreads; t++){
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for(unsigned int t = 0; t<threads.size(); t++){
+		threads[t].join();
 	}
-//	for (unsigned int ii = 0 ;ii<added.size();ii++){
-//		if(!added[ii]){
-//			std::cout<<ii<<" not added\n";
-//		}
-//	}
 }
 
-void Octree::build(const Mesh & m)
+void Octree::build(const Mesh & m, int numThreads)
 {
 	///compute bounding box for m
 	box.mn = m.v[0];
@@ -126,11 +268,68 @@ void Octree::build(const Mesh & m)
 		}
 	}
 
-	std::vector<int>trigs(m.t.size());
-	for(unsigned int ii = 0 ; ii < trigs.size();ii++){
-		trigs[ii] = ii;
+	std::vector<Box> trigBoxes(m.t.size());
+	for(unsigned int ii = 0 ; ii < trigBoxes.size();ii++){
+		trigBoxes[ii] = trigBox(ii, m);
+	}
+
+	//top levels first, stopping at OCTREE_TASK_LEVEL
+	OctreeBuilder top(*this, m, trigBoxes, OCTREE_TASK_LEVEL);
+	top.stack.resize(m.t.size());
+	for(unsigned int ii = 0 ; ii < m.t.size();ii++){
+		top.stack[ii] = ii;
+	}
+	top.nodes.resize(1);
+	top.buildNode(0, box, 0, m.t.size(), 0);
+
+	//then the subtrees below, largest first
+	std::vector<int> order(top.tasks.size());
+	for(unsigned int ii = 0; ii<order.size(); ii++){
+		order[ii] = ii;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b){
+		return top.tasks[a].trigs.size() > top.tasks[b].trigs.size();
+	});
+	std::vector<OctreeBuilder> subs(top.tasks.size(), OctreeBuilder(*this, m, trigBoxes, -1));
+	parallelFor(order.size(), numThreads, [&](int k){
+		const OctreeBuilder::Task & task = top.tasks[order[k]];
+		OctreeBuilder & sub = subs[order[k]];
+		sub.stack = task.trigs;
+		sub.nodes.resize(1);
+		sub.buildNode(0, task.box, 0, task.trigs.size(), task.level);
+		std::vector<int>().swap(sub.stack);
+	});
+	for(unsigned int ii = 0; ii<top.tasks.size(); ii++){
+		top.splice(top.tasks[ii], subs[ii]);
+		std::vector<OctNode>().swap(subs[ii].nodes);
+		std::vector<int>().swap(subs[ii].leafTrigs);
+	}
+
+	//lay out the packs, then copy each leaf's triangles into SoA packs
+	//of four, so a leaf is tested with a few SIMD kernel calls
+	std::vector<int> leaves, firstTrig;
+	int packCount = 0;
+	for(unsigned int ii = 0; ii<top.nodes.size(); ii++){
+		OctNode & node = top.nodes[ii];
+		if(!node.isTerm()){
+			continue;
+		}
+		leaves.push_back(ii);
+		firstTrig.push_back(node.packStart);
+		node.packStart = packCount;
+		node.packCount = (node.trigCount + 3) / 4;
+		packCount += node.packCount;
 	}
-	buildNode(root,box,trigs, m,0);
+	packs.assign(packCount, TrigPack());
+	parallelFor(leaves.size(), numThreads, [&](int k){
+		const OctNode & node = top.nodes[leaves[k]];
+		for(int ii = 0; ii<node.trigCount; ii++){
+			int trig = top.leafTrigs[firstTrig[k] + ii];
+			packs[node.packStart + ii / 4].set(ii % 4, trig, m.v[m.t[trig][0]], m.v[m.t[trig][1]], m.v[m.t[trig][2]]);
+		}
+	});
+	nodes.swap(top.nodes);
+	useArrays(&nodes[0], nodes.size(), packs.empty() ? NULL : &packs[0], packs.size());
 }
 
 int first_node(float tx0,float ty0,float tz0, float txm, float tym,float tzm){
@@ -166,15 +365,23 @@ int new_node(float txm, int x, float tym, int y, float tzm, int z)
 	return z;
 }
 
-void Octree::proc_subtree (float tx0, float ty0, float tz0, float tx1, float ty1, float tz1, OctNode* node)
+void Octree::proc_subtree (float tx0, float ty0, float tz0, float tx1, float ty1, float tz1, const OctNode* node,
+	OctreeQuery & q) const
 {
 float txm, tym, tzm;
 int currNode;
-if(tx1 < 0 || ty1 < 0 || tz1 < 0) {return;}
+if(tx1 < 0 || ty1 < 0 || tz1 < 0 || q.done) {return;}
+if(!q.skipping){q.nodesVisited++;}
 if(node->isTerm()){
-	//loop over things
-	for(unsigned int ii = 0 ; ii<node->obj.size();ii++){
-		termFunc(node->obj[ii],arg);
+	if(q.skipping){
+		q.leavesSkipped++;
+		q.trigsSkipped += node->trigCount;
+		return;
+	}
+	q.leavesVisited++;
+	q.trigsTested += node->trigCount;
+	if(node->packCount>0){
+		q.termFunc(*node,q);
 	}
 	return;
 }
@@ -182,50 +389,73 @@ txm = 0.5*(tx0 + tx1);
 tym = 0.5*(ty0 + ty1);  
 tzm = 0.5*(tz0 + tz1);  
 currNode = first_node(tx0,ty0,tz0,txm,tym,tzm);
+bool startedSkipping = false;
 do{
+	//children come in ray order, so once one starts behind the
+	//nearest hit so far, so do all that follow
+	if(!q.skipping){
+		float cx0 = (currNode&4) ? txm : tx0;
+		float cy0 = (currNode&2) ? tym : ty0;
+		float cz0 = (currNode&1) ? tzm : tz0;
+		if(max(max(cx0,cy0),cz0) > q.tmax*q.tScale){
+			if(!Stats::skipped){
+				return;
+			}
+			q.skipping = true;
+			startedSkipping = true;
+		}
+	}
 	switch (currNode){
 	case 0: {
-		proc_subtree(tx0,ty0,tz0,txm,tym,tzm,node->child[aa]);
+		proc_subtree(tx0,ty0,tz0,txm,tym,tzm,child(node, q.aa),q);
         currNode = new_node(txm,4,tym,2,tzm,1);
         break;}
     case 1: {
-        proc_subtree(tx0,ty0,tzm,txm,tym,tz1,node->child[1^aa]);
+        proc_subtree(tx0,ty0,tzm,txm,tym,tz1,child(node, 1^q.aa),q);
         currNode = new_node(txm,5,tym,3,tz1,8);
         break;}
     case 2: {
-        proc_subtree(tx0,tym,tz0,txm,ty1,tzm,node->child[2^aa]);
+        proc_subtree(tx0,tym,tz0,txm,ty1,tzm,child(node, 2^q.aa),q);
         currNode = new_node(txm,6,ty1,8,tzm,3);
         break;}
     case 3: {
-        proc_subtree(tx0,tym,tzm,txm,ty1,tz1,node->child[3^aa]);
+        proc_subtree(tx0,tym,tzm,txm,ty1,tz1,child(node, 3^q.aa),q);
         currNode = new_node(txm,7,ty1,8,tz1,8);
         break;}
     case 4: {
-        proc_subtree(txm,ty0,tz0,tx1,tym,tzm,node->child[4^aa]);
+        proc_subtree(txm,ty0,tz0,tx1,tym,tzm,child(node, 4^q.aa),q);
         currNode = new_node(tx1,8,tym,6,tzm,5);
         break;}
     case 5: {
-        proc_subtree(txm,ty0,tzm,tx1,tym,tz1,node->child[5^aa]);
+        proc_subtree(txm,ty0,tzm,tx1,tym,tz1,child(node, 5^q.aa),q);
         currNode = new_node(tx1,8,tym,7,tz1,8);
         break;
 			}
     case 6: {
-        proc_subtree(txm,tym,tz0,tx1,ty1,tzm,node->child[6^aa]);
+        proc_subtree(txm,tym,tz0,tx1,ty1,tzm,child(node, 6^q.aa),q);
         currNode = new_node(tx1,8,ty1,8,tzm,7);
         break;}
     case 7: {
-        proc_subtree(txm,tym,tzm,tx1,ty1,tz1,node->child[7^aa]);
+        proc_subtree(txm,tym,tzm,tx1,ty1,tz1,child(node, 7^q.aa),q);
         currNode = 8;
         break;}
     }
-} while (currNode<8);
+} while (currNode<8 && !q.done);
+if(startedSkipping){
+	q.skipping = false;
+}
 }
 
-void Octree::intersect(const Ray & ray){
+void Octree::intersect(OctreeQuery & q) const{
+	const Ray & ray = *q.ray;
 	Vector3f rd=ray.getDirection();
+	q.tScale = rd.abs();
+	q.skipping = false;
+	q.done = false;
 	//assumes rd normalized
 	rd.normalize();
 	Vector3f ro=ray.getOrigin();
+	unsigned char & aa = q.aa;
 	aa=0;
 	Vector3f size = box.mx + box.mn;
 	if(rd[0]<0.0f){
@@ -256,6 +486,103 @@ void Octree::intersect(const Ray & ray){
 	float tz1 = (box.mx[2] - ro[2]) * divz;
 
 	if( max(max(tx0,ty0),tz0) <= min(min(tx1,ty1),tz1) ){
-		proc_subtree(tx0,ty0,tz0,tx1,ty1,tz1, &root);
+		//something nearer was already hit before the ray reaches the mesh
+		if( max(max(tx0,ty0),tz0) > q.tmax*q.tScale ){
+			if(!Stats::skipped){
+				return;
+			}
+			q.skipping = true;
+		}
+		proc_subtree(tx0,ty0,tz0,tx1,ty1,tz1, nodeArray,q);
+	}
+}
+
+void Octree::intersectPacket(OctreePacketQuery & q) const
+{
+	float tnear[PACKET_SIZE];
+	int m = q.packet->hitBox(box, q.tmin, q.tmax, tnear) & q.mask;
+	if(m != 0){
+		visitPacket(nodeArray, box, m, q);
+	}
+}
+
+///@brief visits the node for the lanes in m, which hit its box
+void Octree::visitPacket(const OctNode * node, const Box & nodeBox, int m, OctreePacketQuery & q) const
+{
+	q.nodesVisited++;
+	if(node->isTerm()){
+		if(node->packCount == 0){
+			return;
+		}
+		int lanes = RayPacket::laneCount(m);
+		if(lanes >= PACKET_LEAF_LANES){
+			//each triangle against every lane at once
+			q.leavesVisited += lanes;
+			q.trigsTested += lanes * node->trigCount;
+			if(q.hits != NULL){
+				q.result |= q.mesh->intersectLeafPacket(*node, *q.packet, m, q.hits, q.tmin, q.tmax);
+			}
+			else{
+				int blocked = q.mesh->occludedLeafPacket(*node, *q.packet, m, q.tmin, q.tmax);
+				q.result |= blocked;
+				q.mask &= ~blocked;
+			}
+			return;
+		}
+		for(int lane = 0; lane < PACKET_SIZE; lane++){
+			if(!(m & (1 << lane))){
+				continue;
+			}
+			q.leavesVisited++;
+			q.trigsTested += node->trigCount;
+			const Ray & ray = *q.packet->ray[lane];
+			if(q.hits != NULL){
+				if(q.mesh->intersectLeaf(*node, ray, q.hits[lane], q.tmin)){
+					q.result |= 1 << lane;
+					q.tmax[lane] = q.hits[lane].getT();
+				}
+			}
+			else if(q.mesh->occludedLeaf(*node, ray, q.tmin, q.tmax[lane])){
+				q.result |= 1 << lane;
+				q.mask &= ~(1 << lane);
+			}
+		}
+		return;
+	}
+
+	//test all children, then visit the hit ones nearest first
+	Box cBox[8];
+	float tnear[8][PACKET_SIZE], nearest[8];
+	int cm[8], order[8], count = 0;
+	childBoxes(nodeBox, cBox);
+	for(int c = 0; c < 8; c++){
+		cm[c] = q.packet->hitBox(cBox[c], q.tmin, q.tmax, tnear[c]) & m;
+		if(cm[c] == 0){
+			continue;
+		}
+		nearest[c] = FLT_MAX;
+		for(int lane = 0; lane < PACKET_SIZE; lane++){
+			if((cm[c] & (1 << lane)) && tnear[c][lane] < nearest[c]){
+				nearest[c] = tnear[c][lane];
+			}
+		}
+		int k = count++;
+		for(; k > 0 && nearest[order[k-1]] > nearest[c]; k--){
+			order[k] = order[k-1];
+		}
+		order[k] = c;
+	}
+	for(int k = 0; k < count; k++){
+		int c = order[k];
+		//drop lanes blocked meanwhile, or whose nearest hit is now in front of the child
+		int cmask = cm[c] & q.mask;
+		for(int lane = 0; lane < PACKET_SIZE; lane++){
+			if((cmask & (1 << lane)) && tnear[c][lane] > q.tmax[lane] * 1.0000008f){
+				cmask &= ~(1 << lane);
+			}
+		}
+		if(cmask != 0){
+			visitPacket(child(node, c), cBox[c], cmask, q);
+		}
 	}
 }
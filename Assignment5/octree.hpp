@@ -1,55 +1,132 @@
 #ifndef OCTREE_HPP
 #define OCTREE_HPP
+#include <stdint.h>
+#include <vector>
+#include "Box.h"
+#include "TrigPack.h"
+#include "RayPacket.h"
+#include "Stats.h"
 
-struct Box
-{
-	Vector3f mn, mx;
-	Box(){}
-	Box(const Vector3f & a, const Vector3f & b):
-	mn(a),mx(b)
-	{}
-	Box(float mnx, float mny,float mnz,
-		float mxx,float mxy,float mxz):
-	mn(Vector3f(mnx,mny,mnz)),
-		mx(Vector3f(mxx,mxy,mxz))
-	{}
-};
-
+///@brief node of the flattened octree, 16 bytes so that a traversal
+///touches few cache lines
 struct OctNode
 {
-	OctNode * child[8];
-	OctNode(){
-		child[0] = 0;
+	OctNode():child(0),trigCount(0),packStart(0),packCount(0){
 	}
+	///@brief index in Octree::nodes of the first of the 8 children,
+	///which are stored next to each other; 0 for leaves
+	uint32_t child;
 	///@brief is this terminal
-	bool isTerm(){return child[0]==0;}
-	std::vector<int> obj;
+	bool isTerm() const {return child==0;}
+	///@brief number of triangles in a leaf
+	int trigCount;
+	///@brief range of this leaf's triangles in Octree::packs
+	int packStart, packCount;
 };
 class Mesh;
+class Hit;
+
+///@brief per-call traversal state, kept on the caller's stack so that
+///one octree can be traversed by several threads at once
+struct OctreeQuery
+{
+	const Mesh * mesh;
+	const Ray * ray;
+	///@brief closest-hit queries only, NULL for any-hit queries
+	Hit * hit;
+	float tmin;
+	///@brief nearest hit so far, cells starting behind it are skipped
+	float tmax;
+	///@brief set by termFunc if any triangle was hit
+	bool result;
+	///@brief set by termFunc to end the traversal (any-hit queries)
+	bool done;
+	///@brief indexing mask for negative ray directions
+	unsigned char aa;
+	///@brief length of the ray direction, converts hit t to octree t
+	float tScale;
+	///@brief set while walking cells behind the nearest hit, only to count them
+	bool skipping;
+	int nodesVisited;
+	int leavesVisited, leavesSkipped;
+	int trigsTested, trigsSkipped;
+	///@brief called for every leaf the ray passes through
+	void (*termFunc) (const OctNode & leaf, OctreeQuery & q);
+	///@brief adds the counters to the calling thread's Stats
+	void addStats() const;
+};
+
+///@brief per-call state of a packet traversal, see OctreeQuery
+struct OctreePacketQuery
+{
+	const Mesh * mesh;
+	const RayPacket * packet;
+	///@brief one per lane for closest-hit queries, NULL for any-hit queries
+	Hit * hits;
+	float tmin;
+	///@brief per lane nearest hit (or occlusion distance)
+	float tmax[PACKET_SIZE];
+	///@brief lanes still traced; any-hit lanes drop out once blocked
+	int mask;
+	///@brief lanes that hit (or are blocked)
+	int result;
+	int nodesVisited, leavesVisited, trigsTested;
+	void addStats() const;
+};
+
+//split leaves holding more than OCTREE_MAX_TRIG triangles, down to
+//OCTREE_MAX_LEVEL; both can be overridden per mesh
+#define OCTREE_MAX_TRIG 7
+#define OCTREE_MAX_LEVEL 8
+
 struct Octree
 {
-	//if a node contains more than 7 triangles and it 
+	//if a node contains more than maxTrig triangles and it 
 	//hasn't reached the max level yet, 
 	///split
-	static const int max_trig = 7;
+	int maxTrig;
 	int maxLevel;
-	OctNode root;
-	Octree(int level = 8):
-	maxLevel(level){
+	Octree(int level = OCTREE_MAX_LEVEL, int trig = OCTREE_MAX_TRIG):
+	maxTrig(trig),maxLevel(level),nodes(1){
+		useArrays(&nodes[0], 1, NULL, 0);
 	}
+	//the arrays below may point into nodes and packs
+	Octree(const Octree &) = delete;
+	Octree & operator=(const Octree &) = delete;
 	Box box;
-	void build(const Mesh & m);
-	void buildNode(OctNode  & parent, const Box & pbox ,
-		const std::vector<int>&trigs, 
-		const Mesh & m, int level);
-	
-	///@brief indexing
-	unsigned char aa;
-	void proc_subtree (float tx0, float ty0, float tz0, float tx1, float ty1, float tz1, OctNode* node);
-	void intersect(const Ray & ray);
+	///@brief every node, the root first
+	std::vector<OctNode> nodes;
+	///@brief every leaf's triangles, four to a pack
+	std::vector<TrigPack> packs;
+	///@brief what traversal reads: nodes and packs once built, or
+	///arrays owned by someone else, such as a mapped SceneCache
+	const OctNode * nodeArray;
+	const TrigPack * packArray;
+	int numNodes, numPacks;
+	///@brief builds the tree over the triangles of m; the subtrees
+	///below the top levels are built in parallel
+	///@param numThreads threads to build on, 0 for every hardware thread
+	void build(const Mesh & m, int numThreads = 0);
+	///@brief traverses external arrays, which must outlive the octree
+	void useArrays(const OctNode * nodes, int numNodes, const TrigPack * packs, int numPacks){
+		nodeArray = nodes;
+		this->numNodes = numNodes;
+		packArray = packs;
+		this->numPacks = numPacks;
+	}
+	const OctNode * child(const OctNode * node, int ii) const {return &nodeArray[node->child + ii];}
 	
-	void ** arg;
-	void (*termFunc) (int idx, void ** arg);
+	void proc_subtree (float tx0, float ty0, float tz0, float tx1, float ty1, float tz1, const OctNode* node,
+		OctreeQuery & q) const;
+	///@brief fills q.aa and walks the leaves hit by q.ray front to back,
+	///stopping once the next cell starts behind q.hit
+	void intersect(OctreeQuery & q) const;
+
+	///@brief walks the leaves hit by any lane of q.packet nearest first,
+	///culling cells that start behind each lane's nearest hit. Works best
+	///for coherent packets (RayPacket::coherent).
+	void intersectPacket(OctreePacketQuery & q) const;
+	void visitPacket(const OctNode * node, const Box & box, int m, OctreePacketQuery & q) const;
 };
 Octree buildOctree(const Mesh & m, int maxLevel=7);
 #endif
\ No newline at end of file
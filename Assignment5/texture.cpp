@@ -1,37 +1,71 @@
 #include "texture.hpp"
 #include "bitmap_image.hpp"
+#include <algorithm>
+#include <cmath>
 void
 Texture::load(const char * filename) {
-	bimg=new bitmap_image(filename);
-	height = bimg->height();
-    width = bimg->width();
-}
+	bitmap_image bimg(filename);
+	height = bimg.height();
+    width = bimg.width();
+    levels.clear();
+    if(width<=0 || height<=0){
+        return;
+    }
 
-void
-Texture::operator()(int x, int y,  unsigned char * color) {
-    x = clamp(x,0,width-1);
-    y = clamp(y,0,height-1);
-    bimg->get_pixel(x,y,color[0],color[1],color[2]);
+    // level 0: the bitmap as floats
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.texels.resize(3*width*height);
+    for(int y=0;y<height;y++){
+        for(int x=0;x<width;x++){
+            unsigned char r,g,b;
+            bimg.get_pixel(x,y,r,g,b);
+            float * texel = &base.texels[3*(y*width+x)];
+            texel[0] = r; texel[1] = g; texel[2] = b;
+        }
+    }
+    levels.push_back(base);
+
+    // each further level averages 2x2 texels, clamped at odd edges, down to 1x1
+    while(levels.back().width>1 || levels.back().height>1){
+        const Level & fine = levels.back();
+        Level coarse;
+        coarse.width = std::max(1, fine.width/2);
+        coarse.height = std::max(1, fine.height/2);
+        coarse.texels.resize(3*coarse.width*coarse.height);
+        for(int y=0;y<coarse.height;y++){
+            int y0 = std::min(2*y, fine.height-1), y1 = std::min(2*y+1, fine.height-1);
+            for(int x=0;x<coarse.width;x++){
+                int x0 = std::min(2*x, fine.width-1), x1 = std::min(2*x+1, fine.width-1);
+                float * texel = &coarse.texels[3*(y*coarse.width+x)];
+                for(int ii=0;ii<3;ii++){
+                    texel[ii] = 0.25f*(fine.texel(x0,y0)[ii] + fine.texel(x1,y0)[ii]
+                        + fine.texel(x0,y1)[ii] + fine.texel(x1,y1)[ii]);
+                }
+            }
+        }
+        levels.push_back(coarse);
+    }
 }
+
 bool Texture::valid() {
-	return bimg!=0;
+	return !levels.empty();
 }
-///@param x assumed to be between 0 and 1
+
 Vector3f
-Texture::operator()(float x, float y) {
+Texture::bilinear(const Level & level, float x, float y) const {
 	Vector3f color;
     int ix,iy;
-    x=x*width;
-    y=(1-y)*height;
+    x=x*level.width;
+    y=(1-y)*level.height;
     ix = (int)x;
     iy = (int)y;
-    unsigned char pixels[4][3];
     float alpha = x-ix;
     float beta = y-iy;
-    operator()(ix  ,iy  ,pixels[0]);
-    operator()(ix+1,iy  ,pixels[1]);
-    operator()(ix  ,iy+1,pixels[2]);
-    operator()(ix+1,iy+1,pixels[3]);
+    int x0 = std::min(std::max(ix,0),level.width-1), x1 = std::min(std::max(ix+1,0),level.width-1);
+    int y0 = std::min(std::max(iy,0),level.height-1), y1 = std::min(std::max(iy+1,0),level.height-1);
+    const float * pixels[4] = {level.texel(x0,y0), level.texel(x1,y0), level.texel(x0,y1), level.texel(x1,y1)};
     for(int ii=0;ii<3;ii++){
       color[ii] = (1-alpha)*(1-beta)*pixels[0][ii]
                 +    alpha *(1-beta)*pixels[1][ii]
@@ -41,9 +75,29 @@ Texture::operator()(float x, float y) {
 	return color/255;
 }
 
-Texture::~Texture() {
-	if(bimg!=0) { delete bimg; }
+///@param x assumed to be between 0 and 1
+Vector3f
+Texture::operator()(float x, float y) {
+	return bilinear(levels[0], x, y);
 }
 
-Texture::Texture():bimg(0),width(0),height(0) {}
+Vector3f
+Texture::sample(float x, float y, float footprint) const {
+	// level whose texels are about as wide as the footprint
+	float level = footprint>0 ? std::log2(footprint*std::max(width,height)) : 0;
+	int last = levels.size()-1;
+	if(!(level>0)){
+		return bilinear(levels[0], x, y);
+	}
+	if(level>=last){
+		return bilinear(levels[last], x, y);
+	}
+	int l0 = (int)level;
+	float f = level-l0;
+	return (1-f)*bilinear(levels[l0], x, y) + f*bilinear(levels[l0+1], x, y);
+}
+
+Texture::~Texture() {
+}
 
+Texture::Texture():width(0),height(0) {}
@@ -1,20 +1,34 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
-#include "bitmap_image.hpp"
+#include <vector>
 #include "Vector3f.h"
-///@brief helper class that stores a texture and faciliates lookup
-///assume 4byte RGBA image data
+///@brief helper class that stores a texture and faciliates lookup.
+///The bitmap is converted to float texels once at load time and a mip
+///chain is built, each level a 2x2 box filter of the one above.
 class Texture{
 public:
   Texture();
   bool valid();
   void load(const char * filename);
-  void operator()(int x, int y,  unsigned char * color);
   ///@param x assumed to be between 0 and 1
+  ///@brief bilinear lookup in the full resolution level
   Vector3f operator()(float x, float y);
+  ///@brief trilinear lookup
+  ///@param footprint width of the area to average, in texture
+  ///coordinates (1 spans the texture); 0 samples the full resolution level
+  Vector3f sample(float x, float y, float footprint) const;
+  int numLevels() const {return levels.size();}
   ~Texture();
 private:
-  bitmap_image * bimg;
+  ///@brief one mip level, rgb texels row by row, kept in byte units
+  ///(0-255) so that level 0 samples exactly like the bitmap did
+  struct Level{
+    int width, height;
+    std::vector<float> texels;
+    const float * texel(int x, int y) const {return &texels[3*(y*width+x)];}
+  };
+  Vector3f bilinear(const Level & level, float x, float y) const;
+  std::vector<Level> levels;
   int width , height;
 };
 #endif
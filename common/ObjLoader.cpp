@@ -0,0 +1,386 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// smallest piece of a file worth a thread of its own
+#define OBJ_MIN_CHUNK (1 << 20)
+// longest number handed to strtof when the fast path does not apply
+#define OBJ_MAX_NUMBER 64
+
+// ObjChunk::relative flags, set for indices counted back from the chunk's end
+#define OBJ_RELATIVE_V 1
+#define OBJ_RELATIVE_VT 2
+#define OBJ_RELATIVE_VN 4
+
+// powers of ten that are exact in a float
+static const float obj_pow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+///@brief lines [begin, end) of the file and what they parsed to. Relative
+///indices are counted from the chunk's start until the chunks are merged.
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	std::vector<float> positions, texCoords, normals;
+	std::vector<ObjIndex> indices;
+	///@brief OBJ_RELATIVE_* flags of each corner in indices
+	std::vector<unsigned char> relative;
+	///@brief where this chunk's elements start in the merged mesh
+	int firstV, firstVt, firstVn;
+	size_t firstIndex;
+	int missing;
+};
+
+static inline bool isBlank( char c ) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDigit( char c ) {
+	return c >= '0' && c <= '9';
+}
+
+static bool parseFloat( const char*& p, const char* end, float& out ) {
+	/*
+	Description:
+		Reads one number of a v, vt or vn line. Mantissas up to 2^24 with
+		a decimal exponent up to 10 are exact in a float, so one multiply
+		or divide rounds them correctly, the same as strtof; everything
+		else (long mantissas, inf, nan) goes through strtof.
+	Arguments:
+		- p: read position, left after the number; never moved past the
+		  end of the line.
+		- out: the number.
+	Return:
+		false if the line holds no further number.
+	*/
+
+	// declare variables
+	const char* start;
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool negative = false, any = false;
+
+	while (p < end && isBlank(*p)) { p++; }
+	if (p >= end || *p == '\n') { return false; }
+	start = p;
+
+	if (*p == '-' || *p == '+') { negative = *p == '-'; p++; }
+	for (; p < end && isDigit(*p); p++) {
+		mantissa = mantissa * 10 + (*p - '0');
+		digits += mantissa != 0;
+		any = true;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && isDigit(*p); p++) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+			exponent--;
+			any = true;
+		}
+	}
+	if (any && p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negative_exponent = false;
+		int value = 0;
+		if (q < end && (*q == '-' || *q == '+')) { negative_exponent = *q == '-'; q++; }
+		if (q < end && isDigit(*q)) {
+			for (; q < end && isDigit(*q); q++) { value = std::min(value * 10 + (*q - '0'), 100000); }
+			exponent += negative_exponent ? -value : value;
+			p = q;
+		}
+	}
+
+	if (any && (p >= end || isBlank(*p) || *p == '\n') && digits <= 18
+		&& mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+		float value = float(mantissa);
+		value = exponent < 0 ? value / obj_pow10[-exponent] : value * obj_pow10[exponent];
+		out = negative ? -value : value;
+		return true;
+	}
+
+	// slow path, on a NUL terminated copy since the text may end without one
+	char buffer[OBJ_MAX_NUMBER];
+	size_t length = 0;
+	for (p = start; p < end && !isBlank(*p) && *p != '\n'; p++) {
+		if (length < OBJ_MAX_NUMBER - 1) { buffer[length++] = *p; }
+	}
+	buffer[length] = '\0';
+	out = strtof(buffer, NULL);
+	return true;
+}
+
+///@brief reads a possibly signed integer, false if there are no digits
+static bool parseInt( const char*& p, const char* end, int& out ) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) { negative = *p == '-'; p++; }
+	if (p >= end || !isDigit(*p)) { return false; }
+	int value = 0;
+	for (; p < end && isDigit(*p); p++) { value = value * 10 + (*p - '0'); }
+	out = negative ? -value : value;
+	return true;
+}
+
+///@brief turns a 1-based or negative OBJ index into a 0-based one, -1 for 0
+static inline int resolveIndex( int value, int count, unsigned char& relative, unsigned char flag ) {
+	if (value > 0) { return value - 1; }
+	if (value == 0) { return -1; }
+	relative |= flag;
+	return count + value;
+}
+
+static void parseFace( const char*& p, const char* end, ObjChunk& chunk, std::vector<ObjIndex>& polygon, std::vector<unsigned char>& relative ) {
+	/*
+	Description:
+		Reads the corners of an f line (v, v/vt, v//vn or v/vt/vn) and
+		adds the polygon as a triangle fan.
+	*/
+
+	// declare variables
+	int num_v = chunk.positions.size() / 3;
+	int num_vt = chunk.texCoords.size() / 2;
+	int num_vn = chunk.normals.size() / 3;
+	int value;
+
+	polygon.clear();
+	relative.clear();
+	while (true) {
+		while (p < end && isBlank(*p)) { p++; }
+		if (p >= end || *p == '\n' || !parseInt(p, end, value)) { break; }
+
+		ObjIndex corner = { -1, -1, -1 };
+		unsigned char flags = 0;
+		corner.v = resolveIndex(value, num_v, flags, OBJ_RELATIVE_V);
+		if (p < end && *p == '/') {
+			p++;
+			if (parseInt(p, end, value)) { corner.vt = resolveIndex(value, num_vt, flags, OBJ_RELATIVE_VT); }
+			if (p < end && *p == '/') {
+				p++;
+				if (parseInt(p, end, value)) { corner.vn = resolveIndex(value, num_vn, flags, OBJ_RELATIVE_VN); }
+			}
+		}
+		while (p < end && !isBlank(*p) && *p != '\n') { p++; } // rest of a malformed corner
+		polygon.push_back(corner);
+		relative.push_back(flags);
+	}
+
+	for (size_t k = 1; k + 1 < polygon.size(); k++) {
+		size_t corners[3] = { 0, k, k + 1 };
+		for (int c = 0; c < 3; c++) {
+			chunk.indices.push_back(polygon[corners[c]]);
+			chunk.relative.push_back(relative[corners[c]]);
+		}
+	}
+}
+
+static void parseChunk( ObjChunk& chunk ) {
+	/*
+	Description:
+		Parses the lines of one chunk into its own arrays.
+	*/
+
+	// declare variables
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	std::vector<ObjIndex> polygon;
+	std::vector<unsigned char> relative;
+	float x[3];
+
+	while (p < end) {
+		while (p < end && isBlank(*p)) { p++; }
+		if (end - p > 1 && p[0] == 'v' && isBlank(p[1])) {
+			p++;
+			for (int k = 0; k < 3; k++) { if (!parseFloat(p, end, x[k])) { x[k] = 0.f; } }
+			chunk.positions.insert(chunk.positions.end(), x, x + 3);
+		}
+		else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+			p += 2;
+			for (int k = 0; k < 2; k++) { if (!parseFloat(p, end, x[k])) { x[k] = 0.f; } }
+			chunk.texCoords.insert(chunk.texCoords.end(), x, x + 2);
+		}
+		else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+			p += 2;
+			for (int k = 0; k < 3; k++) { if (!parseFloat(p, end, x[k])) { x[k] = 0.f; } }
+			chunk.normals.insert(chunk.normals.end(), x, x + 3);
+		}
+		else if (end - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+			p++;
+			parseFace(p, end, chunk, polygon, relative);
+		}
+		// skip the rest of the line: comments, groups, materials, extra components
+		while (p < end && *p != '\n') { p++; }
+		p++;
+	}
+}
+
+static void mergeChunk( ObjChunk& chunk, ObjMesh& mesh ) {
+	/*
+	Description:
+		Copies a chunk into its place in the mesh, offsetting relative
+		indices by the elements of the chunks before it and checking
+		every index against the final counts.
+	*/
+
+	// declare variables
+	int num_v = mesh.numVertices();
+	int num_vt = mesh.texCoords.size() / 2;
+	int num_vn = mesh.normals.size() / 3;
+
+	std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + 3 * size_t(chunk.firstV));
+	std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), mesh.texCoords.begin() + 2 * size_t(chunk.firstVt));
+	std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + 3 * size_t(chunk.firstVn));
+
+	chunk.missing = 0;
+	for (size_t k = 0; k < chunk.indices.size(); k++) {
+		ObjIndex corner = chunk.indices[k];
+		unsigned char flags = chunk.relative[k];
+		if (flags & OBJ_RELATIVE_V) { corner.v += chunk.firstV; }
+		if (flags & OBJ_RELATIVE_VT) { corner.vt += chunk.firstVt; }
+		if (flags & OBJ_RELATIVE_VN) { corner.vn += chunk.firstVn; }
+		if (corner.v < 0 || corner.v >= num_v) { corner.v = -1; chunk.missing++; }
+		if (corner.vt < 0 || corner.vt >= num_vt) { corner.vt = -1; }
+		if (corner.vn < 0 || corner.vn >= num_vn) { corner.vn = -1; }
+		mesh.indices[chunk.firstIndex + k] = corner;
+	}
+}
+
+///@brief runs func(0) to func(count - 1), each on its own thread
+template <class Func>
+static void parallelFor( int count, Func func ) {
+	std::vector<std::thread> threads;
+	for (int k = 1; k < count; k++) { threads.push_back(std::thread(func, k)); }
+	if (count > 0) { func(0); }
+	for (size_t k = 0; k < threads.size(); k++) { threads[k].join(); }
+}
+
+bool ObjMesh::parse( const char* text, size_t size, int numThreads ) {
+	/*
+	Description:
+		Splits the text into one chunk of whole lines per thread, parses
+		the chunks in parallel and merges them in order.
+	Arguments:
+		- text: OBJ file contents.
+		- size: length of text in bytes.
+		- numThreads: 0 picks one per hardware thread; small files use
+		  fewer, see OBJ_MIN_CHUNK.
+	Return:
+		false if a face refers to a missing vertex.
+	*/
+
+	// declare variables
+	int num_chunks;
+	int missing = 0;
+
+	positions.clear();
+	texCoords.clear();
+	normals.clear();
+	indices.clear();
+
+	if (numThreads <= 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+	num_chunks = int(std::max<size_t>(1, std::min<size_t>(numThreads, size / OBJ_MIN_CHUNK)));
+
+	// ------------------------- chunks of whole lines -------------------------
+	std::vector<ObjChunk> chunks(num_chunks);
+	const char* end = text + size;
+	const char* begin = text;
+	for (int c = 0; c < num_chunks; c++) {
+		const char* split = c + 1 == num_chunks ? end : text + size / num_chunks * (c + 1);
+		split = std::max(split, begin);
+		while (split < end && split[-1] != '\n') { split++; }
+		chunks[c].begin = begin;
+		chunks[c].end = split;
+		begin = split;
+	}
+	// -------------------------------------------------------------------------
+
+	parallelFor(num_chunks, [&](int c) { parseChunk(chunks[c]); });
+
+	int num_v = 0, num_vt = 0, num_vn = 0;
+	size_t num_indices = 0;
+	for (int c = 0; c < num_chunks; c++) {
+		chunks[c].firstV = num_v;
+		chunks[c].firstVt = num_vt;
+		chunks[c].firstVn = num_vn;
+		chunks[c].firstIndex = num_indices;
+		num_v += chunks[c].positions.size() / 3;
+		num_vt += chunks[c].texCoords.size() / 2;
+		num_vn += chunks[c].normals.size() / 3;
+		num_indices += chunks[c].indices.size();
+	}
+	positions.resize(3 * size_t(num_v));
+	texCoords.resize(2 * size_t(num_vt));
+	normals.resize(3 * size_t(num_vn));
+	indices.resize(num_indices);
+
+	parallelFor(num_chunks, [&](int c) { mergeChunk(chunks[c], *this); });
+
+	for (int c = 0; c < num_chunks; c++) { missing += chunks[c].missing; }
+	if (missing > 0) {
+		std::cout << "OBJ: " << missing << " face corners refer to missing vertices\n";
+		return false;
+	}
+	return true;
+}
+
+bool ObjMesh::load( const char* filename, int numThreads ) {
+
+	// declare variables
+	bool ok;
+
+#ifdef _WIN32
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL) {
+		std::cout << "Cannot open " << filename << "\n";
+		return false;
+	}
+	ok = load(f, numThreads);
+	fclose(f);
+#else
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		std::cout << "Cannot open " << filename << "\n";
+		if (fd >= 0) { close(fd); }
+		return false;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return parse(NULL, 0, numThreads);
+	}
+	void* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		std::cout << "Cannot map " << filename << "\n";
+		return false;
+	}
+	madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+	ok = parse((const char*)mapping, st.st_size, numThreads);
+	munmap(mapping, st.st_size);
+#endif
+	return ok;
+}
+
+bool ObjMesh::load( FILE* f, int numThreads ) {
+
+	// declare variables
+	std::vector<char> text;
+	size_t size = 0, count;
+
+	text.resize(OBJ_MIN_CHUNK);
+	while ((count = fread(&text[size], 1, text.size() - size, f)) > 0) {
+		size += count;
+		if (size == text.size()) { text.resize(2 * text.size()); }
+	}
+	return parse(&text[0], size, numThreads);
+}
@@ -0,0 +1,45 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+///@brief one corner of a triangle: 0-based indices into ObjMesh::positions,
+///texCoords and normals, -1 where the face gave none
+struct ObjIndex
+{
+	int v, vt, vn;
+};
+
+///@brief indexed triangle mesh read from a Wavefront OBJ file, shared by
+///the assignments. Reads v, vt, vn and f lines; polygons are split into
+///triangle fans and negative (relative) indices are resolved. Everything
+///else (groups, materials, lines) is skipped.
+struct ObjMesh
+{
+	///@brief x y z per vertex
+	std::vector<float> positions;
+	///@brief u v per texture coordinate
+	std::vector<float> texCoords;
+	///@brief x y z per normal, as given in the file
+	std::vector<float> normals;
+	///@brief three corners per triangle
+	std::vector<ObjIndex> indices;
+
+	int numVertices() const { return positions.size() / 3; }
+	int numTriangles() const { return indices.size() / 3; }
+
+	///@brief maps the file (reads it where mmap is not available) and
+	///parses it in parallel chunks
+	///@param numThreads 0 picks one per hardware thread
+	///@return false if the file cannot be read or a face refers to a
+	///missing vertex
+	bool load( const char* filename, int numThreads = 0 );
+	///@brief reads the whole stream first, for OBJs piped in on stdin
+	bool load( FILE* f, int numThreads = 0 );
+	///@brief parses OBJ text of size bytes, which need not be NUL terminated
+	bool parse( const char* text, size_t size, int numThreads = 0 );
+};
+
+#endif // OBJ_LOADER_H